@@ -4,6 +4,7 @@
 
 #include <zipfs/zipfs_config.h>
 #include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_session_t.h>
 
 namespace zipfs {
 
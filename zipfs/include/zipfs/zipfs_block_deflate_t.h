@@ -0,0 +1,89 @@
+#pragma once
+
+#include <zip.h>
+#include <vector>
+#include <future>
+#include <functional>
+#include <cstddef>
+
+namespace zipfs {
+
+	class zipfs_block_deflate_t { //pigz-style raw deflate: blocks deflated in parallel, each primed with the last 32K of the previous one, stitched into one stream
+	public:
+
+		typedef std::function<bool(const char* data, size_t byte_sz)> sink_t;//.>compressed data, in order; false: stop
+
+	private:
+
+		struct block_t {
+
+			std::vector<char>
+				data,
+				dict,//.>last 32K of the previous block
+				out;
+
+			zip_uint32_t
+				crc = 0;
+
+			bool
+				ok = false;
+		};
+
+		int
+			m_level;
+
+		size_t
+			m_threads,
+			m_block_sz;
+
+		sink_t
+			m_sink;
+
+		std::vector<block_t> //batch being filled, batch being deflated
+			m_fill,
+			m_deflate;
+
+		std::vector<std::future<void>>
+			m_futures;
+
+		std::vector<char>
+			m_dict;
+
+		zip_uint64_t
+			m_size;
+
+		zip_uint32_t
+			m_crc;
+
+	public:
+
+		zipfs_block_deflate_t(int level, size_t threads, size_t block_sz, const sink_t& sink);
+
+		zipfs_block_deflate_t(const zipfs_block_deflate_t&) = delete;
+
+		~zipfs_block_deflate_t();
+
+	public:
+
+		bool
+			update(const char* data, size_t byte_sz),
+			finish();//.>deflates the last blocks and ends the stream
+
+		zip_uint64_t
+			size() const;//.>input bytes
+
+		zip_uint32_t
+			crc() const;//.>crc32 of the input, combined from the blocks'
+
+	private:
+
+		void
+			launch(bool last);//.>m_fill is deflated in the background, as m_deflate
+
+		bool
+			drain();//.>waits for m_deflate and hands its output to the sink
+
+		static void
+			deflate_block(block_t& block, int level, bool last);
+	};
+}
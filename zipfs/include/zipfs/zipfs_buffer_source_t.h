@@ -0,0 +1,72 @@
+#pragma once
+
+#include <zipfs/zipfs_buffer_t.h>
+#include <zipfs/zipfs_spill_file_t.h>
+#include <zip.h>
+#include <vector>
+#include <memory>
+
+namespace zipfs {
+
+	class zipfs_buffer_source_t { //zip_source_t callback over a zipfs_buffer_t; written data goes to a new segment, the cloned prefix stays shared
+	private:
+
+		zipfs_buffer_t
+			m_buffer;
+
+		zipfs_buffer_t //BEGIN_WRITE_CLONING: shared prefix of m_buffer kept as is
+			m_write_prefix;
+
+		std::vector<char> //data written after m_write_prefix
+			m_write_data;
+
+		zip_uint64_t
+			m_write_offset,
+			m_read_offset;
+
+		zip_uint64_t //heap bytes of the data allowed before it moves to m_spill_file; 0: no budget
+			m_memory_budget,
+			m_write_heap_size;//.>heap bytes of m_buffer when the write began
+
+		std::shared_ptr<zipfs_spill_file_t>
+			m_spill_file;
+
+		bool //data written past the budget goes to a region of m_spill_file instead of m_write_data
+			m_write_spill;
+
+		zip_uint64_t
+			m_write_spill_offset,
+			m_write_spill_size;
+
+		zip_error_t
+			m_error;
+
+	private:
+
+		zipfs_buffer_source_t(const zipfs_buffer_t& buffer);
+
+		~zipfs_buffer_source_t();
+
+	public:
+
+		static zip_source_t* create(const zipfs_buffer_t& buffer, zipfs_buffer_source_t** result, zip_error_t* error);//.>the returned zip_source_t owns *result
+
+		const zipfs_buffer_t& buffer() const;
+
+		void set_memory_budget(zip_uint64_t byte_sz);//.>applies from the next write
+
+	private:
+
+		static zip_int64_t callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+		zip_int64_t command(void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+		zip_int64_t error(int ze);
+
+		zip_uint64_t write_size() const;
+
+		bool spill_write_data();
+
+		bool spill(zipfs_buffer_t& buffer);
+	};
+}
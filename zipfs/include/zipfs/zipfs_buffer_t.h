@@ -0,0 +1,75 @@
+#pragma once
+
+#include <zipfs/zipfs_filesystem_path_t.h>
+#include <zip.h>
+#include <vector>
+#include <memory>
+
+namespace zipfs {
+
+	class zipfs_buffer_t { //immutable archive data made of shared, reference-counted segments; copies are O(segments)
+	public:
+
+		struct segment_t {
+
+			std::shared_ptr<const char>
+				data;
+
+			zip_uint64_t
+				size;
+
+			bool //allocated by zipfs, counts against the memory budget
+				heap = false;
+		};
+
+	private:
+
+		std::vector<segment_t>
+			m_segments;
+
+		std::vector<zip_uint64_t> //m_offsets[s] = offset of m_segments[s]; m_offsets.back() = size()
+			m_offsets;
+
+	public:
+
+		zipfs_buffer_t();
+
+		zipfs_buffer_t(std::vector<char>&& data);//adopts data
+
+		zipfs_buffer_t(const char* data, size_t byte_sz);//copies data
+
+		zipfs_buffer_t(std::shared_ptr<const char> data, zip_uint64_t byte_sz);//shares data
+
+		static bool map(const filesystem_path_t& fs_path, zipfs_buffer_t& result);//.>read-only mapping of the file, unmapped with the last reference
+
+	public:
+
+		zip_uint64_t size() const;
+
+		zip_uint64_t heap_size() const;
+
+		bool empty() const;
+
+		const std::vector<segment_t>& segments() const;
+
+		zip_uint64_t read(zip_uint64_t offset, char* buf, zip_uint64_t len) const;
+
+		bool span(zip_uint64_t offset, zip_uint64_t len, std::shared_ptr<const char>& result) const;//.>pins the segment holding the range; false if the range crosses segments
+
+		void copy_to(std::vector<char>& result) const;
+
+		bool equals(const zipfs_buffer_t& other) const;
+
+	public:
+
+		zipfs_buffer_t prefix(zip_uint64_t byte_sz) const;//shares the segments
+
+		zipfs_buffer_t slice(zip_uint64_t offset, zip_uint64_t byte_sz) const;//shares the segments
+
+		void append(const segment_t& segment);
+
+		void append(std::vector<char>&& data);
+
+		void append(const zipfs_buffer_t& buffer);//.>shares buffer's segments
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <zipfs/zipfs_buffer_t.h>
+#include <zip.h>
+#include <vector>
+
+namespace zipfs {
+
+	class zipfs_cdir_t { //central directory of an archive, parsed from its raw bytes; zip64 and multi-disk archives aren't handled
+	public:
+
+		class record_t { //central directory file header, kept as is
+		private:
+
+			friend class zipfs_cdir_t;
+
+			std::vector<char>
+				m_data;
+
+		public:
+
+			zip_uint64_t local_header_offset() const;
+
+			zip_uint64_t compressed_size() const;
+
+			zip_uint32_t crc() const;
+
+			zip_uint32_t flags() const;
+
+			void set_local_header_offset(zip_uint64_t offset);
+		};
+
+	private:
+
+		std::vector<record_t>
+			m_records;
+
+		zip_uint64_t
+			m_offset,
+			m_size;
+
+		std::vector<char>
+			m_comment;
+
+	public:
+
+		zipfs_cdir_t();
+
+		bool parse(const zipfs_buffer_t& buffer);//.>false if buffer isn't an archive or can't be handled here
+
+		const std::vector<record_t>& records() const;
+
+		zip_uint64_t offset() const;
+
+		zip_uint64_t size() const;
+
+		static bool data_offset(const zipfs_buffer_t& buffer, const record_t& record, zip_uint64_t& result);//.>past the local header
+
+		static bool entry_size(const zipfs_buffer_t& buffer, const record_t& record, zip_uint64_t& result);//.>local header, data and data descriptor
+
+	public:
+
+		static bool align(const zipfs_buffer_t& buffer, zip_uint64_t alignment, zipfs_buffer_t& result);//.>pads local headers so stored entries' data is aligned (zipalign); false if nothing changed or buffer can't be handled here
+
+		static bool write(const std::vector<record_t>& records, zip_uint64_t offset, const std::vector<char>& comment, std::vector<char>& result);//.>central directory and end of central directory record; false past zip64 limits
+
+		const std::vector<char>& comment() const;
+	};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <zipfs/zipfs_cipher_t.h>
+#include <zip.h>
+#include <string>
+#include <vector>
+
+namespace zipfs {
+
+	class zipfs_cipher_source_t { //zip_source_t callback running a lower source through a zipfs_cipher_t, chunk by chunk, as it is read
+	private:
+
+		zip_source_t* //owned
+			m_src;
+
+		zipfs_cipher_t
+			m_cipher;
+
+		std::string
+			m_filename;
+
+		std::string* //set to m_filename when the cipher fails; may be nullptr
+			m_failed;
+
+		void* //cipher state of the open source
+			m_state;
+
+		std::vector<char> //cipher output not read yet, from m_out_offset
+			m_out;
+
+		std::vector<char> //chunk read from m_src
+			m_in;
+
+		size_t
+			m_out_offset;
+
+		bool //m_src was read to the end and the cipher finalized
+			m_final;
+
+		zip_error_t
+			m_error;
+
+	private:
+
+		zipfs_cipher_source_t(zip_source_t* src, const zipfs_cipher_t& cipher, const char* filename, std::string* failed);
+
+		~zipfs_cipher_source_t();
+
+	public:
+
+		static zip_source_t* create(zip_source_t* src, const zipfs_cipher_t& cipher, const char* filename, std::string* failed, zip_error_t* error);//.>takes src over, frees it on error; failed: tells a cipher error from a libzip one
+
+	private:
+
+		static zip_int64_t callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+		zip_int64_t command(void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+		zip_int64_t error(int ze);
+
+		zip_int64_t src_error();
+
+		zip_int64_t cipher_error();
+
+		void release();
+	};
+}
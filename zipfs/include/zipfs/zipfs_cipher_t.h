@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace zipfs {
+
+	struct zipfs_cipher_t { //streaming encryption or decryption: init() once per file, update() per chunk, final() once after a successful init()
+	public:
+
+		typedef void*(*init_func)(void* context, const char* filename);//.>returns the file's state; nullptr: error
+		typedef bool(*update_func)(void* state, const uint8_t* buf, size_t len, std::vector<char>& out);//.>appends to out
+		typedef bool(*final_func)(void* state, std::vector<char>& out);//.>appends the last bytes and releases state; also called after an error
+
+		void* //user data passed to init(), e.g. the archive key
+			context;
+
+		init_func
+			init;
+
+		update_func
+			update;
+
+		final_func
+			final;
+
+	public:
+
+		zipfs_cipher_t();
+
+		zipfs_cipher_t(void* context, init_func init, update_func update, final_func final);
+
+		bool is_set() const;
+	};
+}
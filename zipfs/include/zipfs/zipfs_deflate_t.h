@@ -0,0 +1,48 @@
+#pragma once
+
+#include <zip.h>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+struct z_stream_s;
+
+namespace zipfs {
+
+	class zipfs_deflate_t { //raw deflate stream (zip method 8) with the CRC and size of its input, compressed ahead of commit
+	private:
+
+		std::unique_ptr<z_stream_s>
+			m_strm;
+
+		zip_uint64_t
+			m_size;
+
+		zip_uint32_t
+			m_crc;
+
+	public:
+
+		zipfs_deflate_t();
+
+		zipfs_deflate_t(const zipfs_deflate_t&) = delete;
+
+		~zipfs_deflate_t();
+
+	public:
+
+		bool
+			init(int level),//.>zlib level; -1: default
+			update(const char* data, size_t byte_sz, std::vector<char>& out),//.>appends to out
+			finish(std::vector<char>& out);//.>appends the end of the stream; init() starts a new one
+
+		zip_uint64_t
+			size() const;//.>input bytes
+
+		zip_uint32_t
+			crc() const;//.>crc32 of the input
+
+		static int
+			level(zip_uint32_t compression_flags);//.>zlib level of libzip's compression flags: 1..9, 0: default
+	};
+}
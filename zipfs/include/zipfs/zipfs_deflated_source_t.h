@@ -0,0 +1,49 @@
+#pragma once
+
+#include <zipfs/zipfs_buffer_t.h>
+#include <zip.h>
+#include <ctime>
+
+namespace zipfs {
+
+	class zipfs_deflated_source_t { //zip_source_t callback over data compressed ahead of commit: its stat declares the method, CRC and sizes, so libzip copies the data as is
+	private:
+
+		zipfs_buffer_t //compressed data
+			m_data;
+
+		zip_int32_t
+			m_comp_method;
+
+		zip_uint64_t //uncompressed size
+			m_size;
+
+		zip_uint32_t
+			m_crc;
+
+		time_t
+			m_mtime;
+
+		zip_uint64_t
+			m_offset;
+
+		zip_error_t
+			m_error;
+
+	private:
+
+		zipfs_deflated_source_t(const zipfs_buffer_t& data, zip_int32_t comp_method, zip_uint64_t size, zip_uint32_t crc, time_t mtime);
+
+		~zipfs_deflated_source_t();
+
+	public:
+
+		static zip_source_t* create(const zipfs_buffer_t& data, zip_int32_t comp_method, zip_uint64_t size, zip_uint32_t crc, time_t mtime, zip_error_t* error);//.>the entry's compression must be comp_method, else libzip reads the data as uncompressed
+
+	private:
+
+		static zip_int64_t callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+		zip_int64_t command(void* data, zip_uint64_t len, zip_source_cmd_t cmd);
+	};
+}
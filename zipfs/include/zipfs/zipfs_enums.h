@@ -13,6 +13,16 @@ namespace zipfs {
 		KEEP, DELETE_ //.>underscore cos winnt.h ...
 	};
 
+	enum class OPEN_MODE : uint32_t {
+		FILE_BACKED, //.>read on demand, changes are written to the file
+		MAPPED //.>mapped read-only, pages are read on demand; changes are kept in memory
+	};
+
+	enum class COMMIT_MODE : uint32_t {
+		REWRITE, //.>libzip rewrites the archive from the first changed entry on
+		APPEND //.>changed entries are appended after the archive data and a new central directory is written; replaced and deleted data is left in place
+	};
+
 	enum class QUERY_RESULT : uint32_t {
 		NONE					= 0x00000000,
 		FILE_WRITE				= 0x00000001,
@@ -23,4 +23,23 @@
 #define ZIPFS_ERRSTR_SOURCE_DIR_DOESNT_EXIST		"source directory doesn't exist."
 #define ZIPFS_ERRSTR_COULD_NOT_CREATE_DIR			"could not create directory."
 #define ZIPFS_ERRSTR_TARGET_FILE_ALREADY_EXISTS		"target file already exists."
-#define ZIPFS_ERRSTR_TARGET_FILE_DOESNT_EXIST		"target file doesn't exist."
\ No newline at end of file
+#define ZIPFS_ERRSTR_TARGET_FILE_DOESNT_EXIST		"target file doesn't exist."
+#define ZIPFS_ERRSTR_SESSION_ACTIVE					"a session is active."
+#define ZIPFS_ERRSTR_SESSION_NOT_ACTIVE				"no session is active."
+#define ZIPFS_ERRSTR_INVALID_LOCAL_HEADER			"invalid local header."
+#define ZIPFS_ERRSTR_ARCHIVE_IS_FILE_BACKED			"archive is file-backed."
+#define ZIPFS_ERRSTR_CANNOT_MAP_FILE				"couldn't map file."
+#define ZIPFS_ERRSTR_BUFFER_TOO_SMALL				"buffer is too small."
+#define ZIPFS_ERRSTR_READER_NOT_OPEN				"reader is not open."
+#define ZIPFS_ERRSTR_WRITER_NOT_OPEN				"writer is not open."
+#define ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE		"couldn't write temporary file."
+#define ZIPFS_ERRSTR_FILE_NOT_DEFLATED				"file isn't deflated."
+#define ZIPFS_ERRSTR_CANNOT_INDEX_FILE				"couldn't index deflated file."
+#define ZIPFS_ERRSTR_RANGE_INDEX_MISMATCH			"range index doesn't match the file."
+#define ZIPFS_ERRSTR_CANNOT_CREATE_TEMP_FILE		"couldn't create temporary file."
+#define ZIPFS_ERRSTR_CANNOT_REPLACE_FILE			"couldn't replace file."
+#define ZIPFS_ERRSTR_CANNOT_SYNC_DIRECTORY			"couldn't sync directory."
+#define ZIPFS_ERRSTR_CANNOT_READ_INPUT_FILE			"there was an error reading the input file."
+#define ZIPFS_ERRSTR_CANNOT_COMPRESS				"compression error."
+#define ZIPFS_ERRSTR_CIPHER_ERROR					"encryption/decryption error."
+#define ZIPFS_ERRSTR_INVALID_ALIGNMENT				"alignment must be a power of 2, up to 0x8000."
\ No newline at end of file
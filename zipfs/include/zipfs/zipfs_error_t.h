@@ -14,6 +14,10 @@ namespace zipfs {
 
 		friend struct zipfs_t;
 
+		friend class zipfs_reader_t;
+
+		friend class zipfs_writer_t;
+
 		zip_error_t
 			m_zip_error;
 
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <zip.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace zipfs {
+
+	class zipfs_hash_map_t { //open-addressing (linear probing) map of path -> zip_int64_t; keys are interned in one contiguous arena
+	private:
+
+		struct slot_t {
+
+			uint64_t
+				hash; //s_empty, s_tombstone or the key hash
+
+			uint32_t
+				key_offset, //in m_arena
+				key_size;
+
+			zip_int64_t
+				value;
+		};
+
+		static const uint64_t
+			s_empty = 0,
+			s_tombstone = 1;
+
+		std::vector<slot_t> //size is a power of 2
+			m_slots;
+
+		std::vector<char>
+			m_arena;
+
+		size_t
+			m_size = 0,
+			m_tombstones = 0,
+			m_arena_garbage = 0; //bytes of erased keys still in m_arena
+
+	public:
+
+		bool insert(std::string_view key, zip_int64_t value);
+
+		bool erase(std::string_view key);
+
+		zip_int64_t* find(std::string_view key);
+
+		const zip_int64_t* find(std::string_view key) const;
+
+		void clear();
+
+		size_t size() const;
+
+		bool empty() const;
+
+		template<typename F>
+		void for_each(F f) { //f(std::string_view key, zip_int64_t& value)
+			for (slot_t& s : m_slots)
+				if (s.hash != s_empty && s.hash != s_tombstone)
+					f(std::string_view{ m_arena.data() + s.key_offset, s.key_size }, s.value);
+		}
+
+	private:
+
+		static uint64_t hash(std::string_view key);
+
+		size_t probe(std::string_view key, uint64_t h) const; //slot holding key, or m_slots.size()
+
+		void rehash(size_t slot_count);
+	};
+}
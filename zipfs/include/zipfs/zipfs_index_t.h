@@ -1,30 +1,76 @@
 #pragma once
 
+#include <zipfs/zipfs_config.h>
 #include <zipfs/zipfs_path_t.h>
+#include <zipfs/zipfs_tree_t.h>
 #include <zip.h>
 #include <map>
 #include <list>
+#include <vector>
+#include <memory>
 
 namespace zipfs {
 
+	class zipfs_hash_map_t;
+
 	class zipfs_index_t {
 	private:
 
 		friend struct zipfs_t;
 
-		std::map<zipfs_path_t, zip_int64_t> //maps a zipfs_path_t to its corresponding in-archive zip_int64_t index
+#if ZIPFS_INDEX_T_HASH_MAP
+		std::unique_ptr<zipfs_hash_map_t> //maps a zipfs_path_t to its corresponding in-archive zip_int64_t index; zipfs_hash_map_t.h isn't installed
+			m_map;
+#else
+		std::unique_ptr<std::map<zipfs_path_t, zip_int64_t>> //maps a zipfs_path_t to its corresponding in-archive zip_int64_t index
 			m_map;
+#endif
+
+		std::vector<zip_int64_t> //indexes deleted since the archive was opened; libzip renumbers entries on zip_close()
+			m_deleted;
+
+		zipfs_tree_t //directory tree of m_map's keys; listing a directory only walks its subtree
+			m_tree;
+
+		bool
+			m_is_init = false;
+
+	public:
+
+		zipfs_index_t();
+
+		~zipfs_index_t();
+
+	private:
 
 		bool init(zip_t* z);
 
+		bool is_init() const;
+
+		void commit();
+
 		bool verify(zip_t* z) const;
 
 		bool rename(const zipfs_path_t& zipfs_path, const zipfs_path_t& zipfs_rename_path);
 
+		bool insert(const zipfs_path_t& zipfs_path, zip_int64_t index);
+
+		bool erase(const zipfs_path_t& zipfs_path);
+
 		void clear();
 
 		bool empty() const;
 
 		zip_int64_t index(const zipfs_path_t& zipfs_path) const;
+
+		void ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) const;
+
+	private: //.>m_map
+
+		const zip_int64_t* map_find(const zipfs_path_t& zipfs_path) const;
+
+		bool map_insert(const zipfs_path_t& zipfs_path, zip_int64_t index);
+
+		bool map_erase(const zipfs_path_t& zipfs_path);
 	};
 }
\ No newline at end of file
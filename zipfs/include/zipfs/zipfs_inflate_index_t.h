@@ -0,0 +1,57 @@
+#pragma once
+
+#include <zip.h>
+#include <vector>
+
+namespace zipfs {
+
+	class zipfs_inflate_index_t { //checkpoints of a raw deflate stream every span output bytes (zlib's zran): a ranged read inflates from the nearest one
+	private:
+
+		struct checkpoint_t {
+
+			zip_uint64_t
+				in, //.>compressed offset of the first full byte
+				out;//.>uncompressed offset
+
+			int //bits of the byte before in that belong to the checkpoint's block
+				bits;
+
+			std::vector<unsigned char> //the last 32K of output; empty at offset 0
+				window;
+		};
+
+		std::vector<checkpoint_t>
+			m_checkpoints;
+
+		zip_uint64_t
+			m_span,
+			m_size,
+			m_compressed_size;
+
+		zip_uint32_t
+			m_crc;
+
+	public:
+
+		zipfs_inflate_index_t();
+
+	public:
+
+		bool build(zip_file_t* file, zip_uint64_t span);//.>file is opened with ZIP_FL_COMPRESSED and read to the end
+
+		bool read(zip_file_t* file, zip_uint64_t offset, char* buf, zip_uint64_t len, zip_uint64_t& result) const;//.>file is opened with ZIP_FL_COMPRESSED and seekable
+
+		bool matches(zip_uint64_t size, zip_uint64_t compressed_size, zip_uint32_t crc) const;//.>built for this entry
+
+		void set_entry(zip_uint64_t size, zip_uint64_t compressed_size, zip_uint32_t crc);
+
+		bool empty() const;
+
+	public:
+
+		void save(std::vector<char>& result) const;
+
+		bool load(const std::vector<char>& data);//.>false if data isn't a saved index
+	};
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <zipfs/zipfs_error_t.h>
+#include <zipfs/zipfs_path_t.h>
+#include <zipfs/zipfs_cipher_t.h>
+#include <zip.h>
+#include <vector>
+
+namespace zipfs {
+
+	class zipfs_reader_t { //streams a file out of a snapshot of the archive; opened by zipfs_t::open_reader(), independent of it afterwards
+	private:
+
+		friend struct zipfs_t;
+
+		zip_t* //read-only archive over the snapshot
+			m_zip_t;
+
+		zip_file_t*
+			m_zip_file_t;
+
+		std::vector<char> //decrypted file data, when decryption is set; pending output of the decrypt cipher
+			m_data,
+			m_in;//.>decrypt cipher input
+
+		zip_uint64_t
+			m_size,
+			m_offset;
+
+		zipfs_cipher_t //decrypt cipher, when set
+			m_cipher;
+
+		void*
+			m_state;
+
+		size_t
+			m_data_offset;
+
+		bool //decrypt cipher finalized
+			m_final;
+
+		zipfs_path_t
+			m_zipfs_path;
+
+		bool
+			m_open;
+
+	public:
+
+		zipfs_reader_t();
+
+		zipfs_reader_t(const zipfs_reader_t&) = delete;
+
+		~zipfs_reader_t();
+
+	public:
+
+		zipfs_error_t
+			read(char* buffer, size_t byte_sz, size_t& result);//.>result < byte_sz only at the end of the file; 0: end of file
+
+		zipfs_error_t
+			close();
+
+		bool
+			is_open() const;
+
+		zip_uint64_t
+			size() const,//.>with a decrypt cipher, the size of the encrypted data
+			tell() const;
+
+	private:
+
+		zipfs_error_t
+			_zipfs_read_cipher(char* buffer, size_t byte_sz, size_t& result);
+	};
+}
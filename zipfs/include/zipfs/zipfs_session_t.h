@@ -0,0 +1,33 @@
+#pragma once
+
+#include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_error_t.h>
+
+namespace zipfs {
+
+	class zipfs_session_t { //begins a zipfs_t session; discards it on destruction if it wasn't committed
+	private:
+
+		zipfs_t&
+			m_zipfs_t;
+
+		bool
+			m_active;
+
+	public:
+
+		zipfs_session_t(zipfs_t& zipfs, zipfs_error_t& ze);
+
+		zipfs_session_t(const zipfs_session_t&) = delete;
+
+		~zipfs_session_t();
+
+	public:
+
+		zipfs_error_t
+			commit();
+
+		zipfs_error_t
+			discard();
+	};
+}
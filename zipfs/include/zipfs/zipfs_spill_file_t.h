@@ -0,0 +1,41 @@
+#pragma once
+
+#include <zipfs/zipfs_buffer_t.h>
+#include <zip.h>
+#include <memory>
+
+namespace zipfs {
+
+	class zipfs_spill_file_t : public std::enable_shared_from_this<zipfs_spill_file_t> { //anonymous temporary file holding archive data past the memory budget; written regions are mapped as segments
+	private:
+
+#ifdef _WIN32
+		void*
+			m_handle;
+#else
+		int
+			m_fd;
+#endif
+
+		zip_uint64_t
+			m_size;
+
+		zipfs_spill_file_t();
+
+	public:
+
+		~zipfs_spill_file_t();
+
+		static std::shared_ptr<zipfs_spill_file_t> create();//.>nullptr on error
+
+		zip_uint64_t region();//.>offset of a new region at the end of the file, aligned for mapping
+
+		bool write(zip_uint64_t offset, const char* data, zip_uint64_t byte_sz);
+
+		bool map(zip_uint64_t offset, zip_uint64_t byte_sz, zipfs_buffer_t::segment_t& result);//.>the segment keeps the file open; a region is mapped once, its space is released with the segment
+
+	private:
+
+		void release(zip_uint64_t offset, zip_uint64_t byte_sz);//.>punches the region's pages out of the file: the file keeps its size, not its blocks
+	};
+}
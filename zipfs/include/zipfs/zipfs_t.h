@@ -8,43 +8,127 @@
 #include <zipfs/zipfs_query_results_t.h>
 #include <zipfs/zipfs_index_t.h>
 #include <zipfs/zipfs_zip_flags.h>
+#include <zipfs/zipfs_buffer_t.h>
+#include <zipfs/zipfs_view_t.h>
+#include <zipfs/zipfs_reader_t.h>
+#include <zipfs/zipfs_writer_t.h>
+#include <zipfs/zipfs_cipher_t.h>
 #include <zip.h>
 #include <vector>
 #include <map>
+#include <set>
+#include <memory>
+#include <cstddef>
+#include <functional>
+#include <ios>
+#include <ostream>
 
 #define ZIPFS_USE_ZIPFS_INDEX 1
 
 namespace zipfs {
 
+	class zipfs_buffer_source_t;
+	class zipfs_cdir_t;
+	class zipfs_inflate_index_t;
+	class zipfs_spill_file_t;
+
 	struct zipfs_t { //zip 'heap' filesystem interface
 	private:
 
+		friend class zipfs_writer_t;
+
 		zip_source_t*
-			m_zip_source_t;
+			m_zip_source_t = nullptr;
+
+		zipfs_buffer_source_t* //owned by m_zip_source_t
+			m_zipfs_buffer_source_t = nullptr;
+
+		zipfs_buffer_t //shares its segments with the source data; updating or reverting the image doesn't copy
+			m_zip_source_t_image_user;
+
+		zip_uint64_t //bumped each time changes are written to the source data
+			m_generation = 0,
+			m_generation_image_user = 0;
 
-		std::vector<char>
-			m_zip_source_t_image_user,
-			m_zip_source_t_image_internal;
+		std::set<zipfs_path_t> //paths changed since the last zipfs_image_update()
+			m_image_modifications;
 
 		zip_t*
-			m_zip_t;
+			m_zip_t = nullptr;
 
-		char*
-			m_zip_source_t_buffer;
+		filesystem_path_t //file-backed archive; empty for an archive in memory
+			m_fs_path;
 
-#define ZIPFS_ZIP_SOURCE_T_BUFFER_AUTO_FREE 1 //<.buggy if 0
+		int //ZIP_CHECKCONS reads every local header: skipped for a mapped archive, its pages are read on demand
+			m_open_flags = ZIP_CHECKCONS;
 
-		const static bool
-			s_zip_source_t_buffer_auto_free = ZIPFS_ZIP_SOURCE_T_BUFFER_AUTO_FREE;
+		zip_uint64_t //heap bytes of source data past which it moves to a temporary file; 0: no budget
+			m_memory_budget = 0;
 
 		zip_int32_t
-			m_compression;
+			m_compression = ZIP_CM_DEFLATE;
 
 		zip_uint32_t
-			m_compression_flags;
+			m_compression_flags = 0;
+
+		zip_uint64_t //stored entries' data is aligned on commit; 0: no alignment
+			m_alignment = 0;
 
 		zipfs_error_t
-			m_ze;
+			m_ze = zipfs_error_t::no_error();
+
+		bool
+			m_session = false;//.>m_zip_t is kept open until session_commit() / session_discard()
+
+		std::vector<zipfs_path_t> //paths changed since m_zip_t was opened; cleared when changes are written or dropped
+			m_pending_changes;
+
+		std::vector<char> //cat() input of the decrypt function or cipher, reused across calls
+			m_cat_buffer,
+			m_cat_cipher_buffer;//.>cipher output
+
+		std::unique_ptr<zipfs_cdir_t> //central directory of the source data at m_view_cdir_generation, for view()
+			m_view_cdir;
+
+		bool
+			m_view_cdir_parsed = false;
+
+		zip_uint64_t
+			m_view_cdir_generation = 0;
+
+		std::map<zipfs_path_t, std::unique_ptr<zipfs_inflate_index_t>> //deflated files' checkpoints for read_range(), built on first use
+			m_inflate_indexes;
+
+		zip_uint64_t //uncompressed bytes between checkpoints
+			m_range_index_span = 1 << 20;
+
+		unsigned int //dir_extract() worker threads; 1: sequential
+			m_extract_threads = 1,
+			m_pull_threads = 1,//.>dir_pull() workers reading, encrypting and compressing files
+			m_block_deflate_threads = 1;//.>file_pull() workers deflating blocks of a large file
+
+		zip_uint64_t //smallest file deflated in blocks
+			m_block_deflate_min_size = 1 << 26;
+
+		struct pending_source_t {
+
+			zip_source_t*
+				src;
+
+			zip_int32_t
+				compression;
+
+			zip_uint32_t
+				compression_flags;
+		};
+
+		struct pull_job_t;//.>dir_pull() file prepared by a worker
+
+		std::map<zip_int64_t, pending_source_t> //sources added since m_zip_t was opened, by entry index; kept (ref++) for COMMIT_MODE::APPEND
+			m_pending_sources;
+
+		COMMIT_MODE
+			m_commit_mode = COMMIT_MODE::REWRITE;
 
 	public:
 
@@ -54,27 +138,53 @@ namespace zipfs {
 	private:
 
 		file_encrypt_func
-			m_file_encrypt_func;
+			m_file_encrypt_func = nullptr;
 
 		file_decrypt_func
-			m_file_decrypt_func;
+			m_file_decrypt_func = nullptr;
+
+		zipfs_cipher_t //streaming; takes precedence over m_file_encrypt_func / m_file_decrypt_func
+			m_file_encrypt_cipher,
+			m_file_decrypt_cipher;
+
+		std::string //entry whose encrypt cipher failed as zip_close() read it
+			m_cipher_failed;
 
 		bool
-			m_file_encrypt,
-			m_file_decrypt;
+			m_file_encrypt = false,
+			m_file_decrypt = false;
 
 	private:
 
 		zipfs_index_t					//this index because zip_name_locate() is giving me trouble (should be patched in next libzip version [now=26.03.2022])
-			m_zipfs_index_t,			//maps a zipfs_path_t to its corresponding in-archive zip_int64_t index
-			m_zipfs_index_t_image_user,
-			m_zipfs_index_t_image_internal;
+			m_zipfs_index_t;			//maps a zipfs_path_t to its corresponding in-archive zip_int64_t index
 
 	public:
 
 		zipfs_t(zipfs_error_t& ze); //.>creates an empty archive in memory
 
-		zipfs_t(char* buffer, size_t byte_sz, zipfs_error_t& ze); //.>creates an archive in memory from buffer
+		zipfs_t(char* buffer, size_t byte_sz, zipfs_error_t& ze); //.>creates an archive in memory from buffer (copy)
+
+		zipfs_t(std::vector<char>&& buffer, zipfs_error_t& ze); //.>creates an archive in memory from buffer, no copy: buffer is moved from
+
+		/*
+			no copy: buffer is shared with the caller, it must not be modified until every reference is released.
+			zipfs_t never writes to buffer; changes go to new memory.
+		*/
+		zipfs_t(std::shared_ptr<const std::byte[]> buffer, size_t byte_sz, zipfs_error_t& ze);
+
+		/*
+			file-backed: the archive is read from fs_path on demand and never held in memory (created if it doesn't exist).
+			changes are written to a temporary file renamed over fs_path (libzip); an archive left without entries is removed.
+			there is no image data: zipfs_revert_to_image() is a usage error, zipfs_image_update() only resets modifications.
+		*/
+		zipfs_t(const filesystem_path_t& fs_path, zipfs_error_t& ze);
+
+		/*
+			OPEN_MODE::MAPPED: the archive file is mapped read-only, opening it only reads its central directory.
+			changes are kept in memory like for an archive created from a buffer; the file is never written and must not be modified while mapped.
+		*/
+		zipfs_t(const filesystem_path_t& fs_path, OPEN_MODE open_mode, zipfs_error_t& ze);
 
 		zipfs_t(const zipfs_t&) = delete;
 
@@ -90,7 +200,16 @@ namespace zipfs {
 		*/
 
 		bool
-			_zipfs_source_new(char* buffer, size_t byte_sz);
+			_zipfs_source_new(const zipfs_buffer_t& buffer);
+
+		bool
+			_zipfs_source_new_file();
+
+		void
+			_zipfs_source_init(const zipfs_buffer_t& buffer, zipfs_error_t& ze);
+
+		bool
+			_zipfs_file_backed() const;
 
 		void
 			_zipfs_source_free();
@@ -101,11 +220,13 @@ namespace zipfs {
 		bool
 			_zipfs_open(int open_flags);
 
-		void
-			_zipfs_close(),
-			_zipfs_unchange_all(),
+		bool
+			_zipfs_close(),//.>false: the archive couldn't be written, m_zip_t is discarded; m_ze keeps the operation's error if any, else the commit's
 			_zipfs_no_error_and_close();
 
+		void
+			_zipfs_unchange_all();
+
 		/*
 			we could return m_ze& here
 		*/
@@ -122,31 +243,77 @@ namespace zipfs {
 
 		bool
 			_zipfs_file_add_or_pull_from_source(const zipfs_path_t& zipfs_path, zip_source_t* src, zip_int64_t& index),
-			_zipfs_file_add_replace_or_pull_replace_from_source(zip_int64_t index, zip_source_t* src);
+			_zipfs_file_add_replace_or_pull_replace_from_source(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_source_t* src);
 
 		bool
 			_zipfs_dir_pull(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, zipfs_query_results_t* query_results, OVERWRITE overwrite, ORPHAN orphan, bool is_query),
 			_zipfs_dir_extract(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, zipfs_query_results_t* query_results, OVERWRITE overwrite, bool is_query);
 
 		bool
-			_zipfs_source_buffer_encrypt(const zipfs_path_t& zipfs_path, const std::vector<char>& buffer, zip_source_t** src);
+			_zipfs_source_buffer_encrypt(const zipfs_path_t& zipfs_path, const char* buffer, size_t byte_sz, zip_source_t** src),
+			_zipfs_source_block_deflate(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, zip_source_t** src),//.>the file deflated in blocks on m_block_deflate_threads
+			_zipfs_block_deflate_file(const filesystem_path_t& fs_path) const;//.>pulled through _zipfs_source_block_deflate()
+
+		bool
+			_zipfs_encrypt_func() const,//.>whole-file encryption
+			_zipfs_encrypt_cipher() const,//.>streaming encryption
+			_zipfs_decrypt_func() const,
+			_zipfs_decrypt_cipher() const;
 
 		bool
 			_zipfs_set_dir_mtime(const zipfs_path_t& zipfs_path, time_t mtime);
 
+		void
+			_zipfs_pending_change(const zipfs_path_t& zipfs_path),
+			_zipfs_pending_source(zip_int64_t index, zip_source_t* src),
+			_zipfs_pending_revert(const zipfs_path_t& zipfs_path),//.>undoes the last _zipfs_pending_change of zipfs_path, for a failed operation
+			_zipfs_entry_add_revert(const zipfs_path_t& zipfs_path, zip_int64_t index),//.>a failed operation drops the entry it added
+			_zipfs_pending_changes_written(),
+			_zipfs_pending_clear();
+
 		bool
-			_zipfs_revert_to_image_internal(),
-			_zipfs_image_internal_update();
+			_zipfs_commit(),
+			_zipfs_commit_append(zipfs_buffer_t& result, bool& append),
+			_zipfs_commit_align(zipfs_buffer_t& buffer);
 
 		QUERY_RESULT
 			_zipfs_get_query_result(OVERWRITE overwrite, ORPHAN orphan, const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path),//pull
 			_zipfs_get_query_result(OVERWRITE overwrite, const filesystem_path_t& fs_path, const zipfs_path_t& zipfs_path),//extract
 			_zipfs_get_query_result(OVERWRITE overwrite, const zipfs_path_t& zipfs_path);//add
 
+		bool
+			_zipfs_cat(const zipfs_path_t& zipfs_path, std::vector<char>& result, bool read_compressed),
+			_zipfs_cat_size(const zipfs_path_t& zipfs_path, bool read_compressed, zip_int64_t& index, zip_uint64_t& result),
+			_zipfs_cat_read(const zipfs_path_t& zipfs_path, zip_int64_t index, char* buffer, zip_uint64_t byte_sz, bool read_compressed),
+			_zipfs_source_chunks(const std::function<bool(const char* data, size_t byte_sz)>& sink),//.>the archive source data; sink returns false to stop
+			_zipfs_cat_chunks(const zipfs_path_t& zipfs_path, zip_int64_t index, bool read_compressed, const std::function<bool(const char* data, size_t byte_sz)>& sink),//.>through the decrypt cipher if set; sink returns false to stop
+			_zipfs_view(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_uint64_t byte_sz, zipfs_view_t& result),//.>false: no direct view, not an error
+			_zipfs_range_index(const zipfs_path_t& zipfs_path, zip_int64_t index, zipfs_inflate_index_t*& result),
+			_zipfs_read_range(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_uint64_t offset, char* buffer, zip_uint64_t byte_sz);
+
 		bool
 			_zipfs_file_pull(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, QUERY_RESULT qr),
 			_zipfs_file_extract(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, QUERY_RESULT qr),
-			_zipfs_file_add(const zipfs_path_t& zipfs_path, const std::vector<char>& buffer, QUERY_RESULT qr);
+			_zipfs_file_extract_chunks(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, std::ios::openmode open_mode),
+			_zipfs_file_extract_worker(zip_t* zip, zip_int64_t index, const zipfs_query_result_t& query_result, std::vector<char>& in, std::vector<char>& out, zipfs_error_t& ze) const,//.>thread-safe: own zip, buffers and error
+			_zipfs_dir_extract_parallel(const zipfs_query_results_t& query_results),
+			_zipfs_dir_pull_parallel(const zipfs_query_results_t& query_results),
+			_zipfs_file_pull_prepare(pull_job_t& job, bool deflate, std::vector<char>& in, std::vector<char>& out) const,//.>thread-safe: own job and buffers
+			_zipfs_file_pull_prepared(const pull_job_t& job, bool deflate, const zipfs_buffer_t& data),//.>data: the job's, mapped from the spill file
+			_zipfs_file_add(const zipfs_path_t& zipfs_path, const char* buffer, size_t byte_sz, const zipfs_buffer_t* stream, QUERY_RESULT qr);//.>stream: zipfs_writer_t data instead of buffer
+
+		zipfs_error_t
+			_zipfs_writer_finish(zipfs_writer_t& writer);
+
+		zip_t*
+			_zipfs_snapshot_open();//.>own read-only archive over a snapshot of the source data, same entry indexes; nullptr: error
+
+		static bool
+			_zipfs_zip_file_chunks(zip_t* zip, zip_int64_t index, bool read_compressed, const zipfs_path_t& zipfs_path, const zipfs_cipher_t* cipher,
+				std::vector<char>& in, std::vector<char>& out, const std::function<bool(const char* data, size_t byte_sz)>& sink, zipfs_error_t& ze);//.>thread-safe
+
+		static bool
+			_zipfs_zip_file_meta_copy(zip_t* zip, zip_uint64_t index, zip_t* dest_zip, zip_uint64_t dest_index);//.>external attributes, comment and extra fields of a re-added entry; on error dest_zip's error is set
 
 	//\.end internal
 
@@ -179,6 +346,17 @@ namespace zipfs {
 		zipfs_error_t
 			dir_extract_query(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, zipfs_query_results_t& query_results, OVERWRITE overwrite = OVERWRITE::NEVER);
 
+		/*
+			set_extract_threads: past 1, dir_extract() calls the decryption function, or the cipher's init / update / final,
+			from several threads at once: they must be thread-safe. A cipher's state is per file; its context is shared.
+			set_pull_threads: likewise, past 1, dir_pull() calls the encryption function, or the cipher, from several threads at once.
+			prepared data goes to a temporary file as the files are added: memory holds the files in flight only.
+		*/
+		void
+			set_extract_threads(unsigned int threads),//.>files extracted concurrently by dir_extract(); 0: one per core; default 1
+			set_pull_threads(unsigned int threads),//.>files read, encrypted and compressed concurrently by dir_pull(); 0: one per core; default 1
+			set_block_deflate(unsigned int threads, zip_uint64_t min_file_sz = 1 << 26);//.>files pulled from min_file_sz on are deflated in blocks, pigz-style, parallel dir_pull() included; 0: one thread per core; default 1: off
+
 
 	public: //.>write operations [<-memory]
 
@@ -186,6 +364,9 @@ namespace zipfs {
 			file_add(const zipfs_path_t& zipfs_path, const std::vector<char>& buffer, OVERWRITE overwrite = OVERWRITE::NEVER),
 			file_add(const zipfs_path_t& zipfs_path, const std::string& buffer, OVERWRITE overwrite = OVERWRITE::NEVER);
 
+		zipfs_error_t
+			open_writer(const zipfs_path_t& zipfs_path, zipfs_writer_t& result, OVERWRITE overwrite = OVERWRITE::NEVER);//.>the file is added on zipfs_writer_t::finish()
+
 		zipfs_error_t
 			file_delete(const zipfs_path_t& zipfs_path);
 
@@ -205,7 +386,18 @@ namespace zipfs {
 	public: //.>read-only operations [->memory]
 
 		zipfs_error_t
-			cat(const zipfs_path_t& zipfs_path, std::vector<char>& result, bool read_compressed = false);
+			cat(const zipfs_path_t& zipfs_path, std::vector<char>& result, bool read_compressed = false),//.>result's capacity is reused
+			cat(const zipfs_path_t& zipfs_path, char* buffer, size_t byte_sz, size_t& result, bool read_compressed = false),//.>result: bytes read, or needed if byte_sz is too small
+			cat(const std::vector<zipfs_path_t>& zipfs_paths, std::vector<std::vector<char>>& results, bool read_compressed = false);//.>opens the archive once
+
+		zipfs_error_t
+			open_reader(const zipfs_path_t& zipfs_path, zipfs_reader_t& result, bool read_compressed = false);//.>reads the archive as it is now; with decryption: the whole file is decrypted on open
+
+		zipfs_error_t
+			view(const zipfs_path_t& zipfs_path, zipfs_view_t& result);//.>no copy for stored, unencrypted files
+
+		zipfs_error_t
+			cat_size(const zipfs_path_t& zipfs_path, size_t& result, bool read_compressed = false);//.>with decryption: size before decryption
 
 		zipfs_error_t
 			ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict = true);
@@ -224,6 +416,16 @@ namespace zipfs {
 
 		zipfs_error_t
 			get_source(std::vector<char>& result);
+
+		zipfs_error_t
+			source_size(zip_uint64_t& result);//.>bytes write_source() writes, e.g. to preallocate
+
+		zipfs_error_t
+			write_source(int fd, bool sync = false),//.>streamed in chunks from the current position; sync: fsync() once written
+			write_source(std::ostream& os);//.>streamed in chunks, then flushed
+
+		zipfs_error_t
+			save(const filesystem_path_t& fs_path);//.>atomic and durable: temporary file, fsync, rename over fs_path, fsync of the directory
 #if 0
 		//afaik libzip doesn't enable this
 		zipfs_error_t
@@ -233,7 +435,10 @@ namespace zipfs {
 	public: //.>image data
 
 		zipfs_error_t
-			zipfs_image_has_modifications(bool& result);
+			zipfs_image_has_modifications(bool& result);//.>constant time; true once changes were written, even if they restore the image data
+
+		zipfs_error_t
+			zipfs_image_modifications(std::vector<zipfs_path_t>& result) const;//.>paths changed since the last zipfs_image_update(), sorted
 
 		zipfs_error_t
 			zipfs_revert_to_image();
@@ -242,11 +447,97 @@ namespace zipfs {
 			zipfs_image_update();
 
 
+	public: //.>session
+
+		/*
+			while a session is active, the archive stays open and every operation is kept pending;
+			the archive is written once on session_commit().
+			- entries added or replaced during the session can't be read back (cat) until commit.
+			- files pulled during the session are read from the filesystem on commit.
+			- a failed operation undoes its own changes and returns the error; the pending changes of the
+			  operations before it are kept (the parent directories it created, as outside a session, too).
+			  session_rollback() drops them all.
+			- dir_pull() stops at its first error: the files it pulled before stay pending.
+		*/
+		zipfs_error_t
+			session_begin();
+
+		zipfs_error_t
+			session_commit();
+
+		zipfs_error_t
+			session_discard();
+
+		zipfs_error_t
+			session_rollback();//.>drops pending changes, the session stays active
+
+		zipfs_error_t
+			session_pending_changes(std::vector<zipfs_path_t>& result) const;
+
+		bool
+			session_is_active() const;
+
+
+	public: //.>ranged reads
+
+		/*
+			stored files are read from offset; deflated files are inflated from the nearest checkpoint, indexed on first read (zlib's zran).
+			other compression methods and encrypted files are inflated from the start.
+		*/
+		zipfs_error_t
+			read_range(const zipfs_path_t& zipfs_path, zip_uint64_t offset, zip_uint64_t byte_sz, std::vector<char>& result);//.>result is cut at the end of the file
+
+		void
+			set_range_index_span(zip_uint64_t byte_sz);//.>default 1 MiB; ~32K of memory per checkpoint
+
+		zipfs_error_t
+			range_index_save(const zipfs_path_t& zipfs_path, std::vector<char>& result),//.>builds the index if needed
+			range_index_load(const zipfs_path_t& zipfs_path, const std::vector<char>& data);//.>fails if data wasn't saved for the file as it is now
+
+
 	public: //.>compression
 
 		void
 			set_compression(zip_int32_t compression, zip_uint32_t compression_flags = 0);
 
+		/*
+			pads local headers on commit so stored, unencrypted entries' data starts on a multiple of alignment (zipalign: 0xd935 extra field).
+			power of 2, up to 0x8000; 0 (default): no alignment. archives in memory only, zip64 archives aren't aligned.
+		*/
+		void
+			set_alignment(zip_uint64_t alignment);
+
+
+	public: //.>memory
+
+		/*
+			source data written past byte_sz heap bytes moves to an anonymous temporary file, mapped back on demand.
+			applies from the next write; data still referenced by the image stays in memory.
+		*/
+		void
+			set_memory_budget(zip_uint64_t byte_sz);
+
+
+	public: //.>commit
+
+		/*
+			COMMIT_MODE::APPEND writes changes in O(change): replaced, renamed and deleted data stays in the archive as dead space.
+			archives it can't handle (zip64, prepended data) are rewritten as with COMMIT_MODE::REWRITE.
+		*/
+		void
+			set_commit_mode(COMMIT_MODE commit_mode);
+
+		/*
+			rewrites the archive with its live entries only, copied raw (no recompression).
+			dead space is left by COMMIT_MODE::APPEND; zip64 archives aren't measured (0).
+		*/
+		zipfs_error_t
+			compact(zip_int64_t& reclaimed);
+
+		zipfs_error_t
+			dead_space(zip_uint64_t& result),
+			dead_space_ratio(double& result);
+
 
 	public: //.>encryption/decryption
 
@@ -257,6 +548,14 @@ namespace zipfs {
 		void
 			set_file_encrypt_func(file_encrypt_func f),
 			set_file_decrypt_func(file_decrypt_func f);
+
+		/*
+			streaming encryption/decryption, driven chunk by chunk in add, pull, cat and extract: memory is bounded by the chunk size.
+			takes precedence over the file_encrypt_func / file_decrypt_func; set_file_encrypt() / set_file_decrypt() still switch it on and off.
+		*/
+		void
+			set_file_encrypt_cipher(const zipfs_cipher_t& cipher),
+			set_file_decrypt_cipher(const zipfs_cipher_t& cipher);
 	};
 
 	//\. end public interface
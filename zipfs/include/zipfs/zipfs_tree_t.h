@@ -0,0 +1,52 @@
+#pragma once
+
+#include <zipfs/zipfs_path_t.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace zipfs {
+
+	class zipfs_tree_t { //directory tree of the archive entries; one node per path component
+	private:
+
+		friend class zipfs_index_t;
+
+		struct node_t {
+
+			std::map<std::string, size_t> //path component ("name" or "name/") -> node
+				children;
+
+			bool
+				entry = false; //false if the node is only implied by a deeper entry
+		};
+
+		std::vector<node_t> //m_nodes[0] is root
+			m_nodes;
+
+		std::vector<size_t> //recycled nodes
+			m_free;
+
+	public:
+
+		zipfs_tree_t();
+
+	private:
+
+		void insert(const zipfs_path_t& zipfs_path);
+
+		bool erase(const zipfs_path_t& zipfs_path);
+
+		void clear();
+
+		void ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) const;
+
+	private:
+
+		static std::vector<std::string> components(const zipfs_path_t& zipfs_path);
+
+		void ls(size_t node, const std::string& path, std::vector<zipfs_path_t>& result) const;
+
+		size_t node_new();
+	};
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <cstddef>
+
+namespace zipfs {
+
+	class zipfs_view_t { //read-only bytes of a file; they stay valid whatever happens to the archive afterwards
+	private:
+
+		std::shared_ptr<const char>
+			m_data;
+
+		size_t
+			m_size;
+
+		bool //points into the archive source data
+			m_direct;
+
+	public:
+
+		zipfs_view_t();
+
+		zipfs_view_t(std::shared_ptr<const char> data, size_t byte_sz, bool direct);
+
+	public:
+
+		const char* data() const;
+
+		size_t size() const;
+
+		bool empty() const;
+
+		bool direct() const;//.>false: the data was copied
+	};
+}
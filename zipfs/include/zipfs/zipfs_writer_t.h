@@ -0,0 +1,69 @@
+#pragma once
+
+#include <zipfs/zipfs_error_t.h>
+#include <zipfs/zipfs_path_t.h>
+#include <zipfs/zipfs_enums.h>
+#include <zip.h>
+#include <vector>
+#include <memory>
+
+namespace zipfs {
+
+	struct zipfs_t;
+	class zipfs_spill_file_t;
+
+	class zipfs_writer_t { //streams a file into a zipfs_t: written data goes to an anonymous temporary file, the file is added on finish(); must not outlive its zipfs_t
+	private:
+
+		friend struct zipfs_t;
+
+		zipfs_t*
+			m_zipfs_t;
+
+		zipfs_path_t
+			m_zipfs_path;
+
+		OVERWRITE
+			m_overwrite;
+
+		std::shared_ptr<zipfs_spill_file_t>
+			m_spill_file;
+
+		zip_uint64_t
+			m_offset,//.>region of m_spill_file
+			m_size;
+
+		std::vector<char> //data not written to m_spill_file yet
+			m_buffer;
+
+	public:
+
+		zipfs_writer_t();
+
+		zipfs_writer_t(const zipfs_writer_t&) = delete;
+
+		~zipfs_writer_t();
+
+	public:
+
+		zipfs_error_t
+			write(const char* data, size_t byte_sz),
+			write(const std::vector<char>& data);
+
+		zipfs_error_t
+			finish();//.>adds the file as file_add() does, then closes the writer
+
+		void
+			discard();
+
+		bool
+			is_open() const;
+
+		zip_uint64_t
+			size() const;
+
+	private:
+
+		bool flush();
+	};
+}
@@ -0,0 +1,115 @@
+#include <zipfs/zipfs_block_deflate_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zlib.h>
+#include <algorithm>
+
+namespace zipfs {
+
+	namespace {
+
+		constexpr size_t dict_sz = 1 << 15;//.>deflate window
+	}
+
+	zipfs_block_deflate_t::zipfs_block_deflate_t(int level, size_t threads, size_t block_sz, const sink_t& sink) :
+		m_level{ level }, m_threads{ std::max<size_t>(threads, 1) }, m_block_sz{ std::max(block_sz, dict_sz) }, m_sink{ sink }, m_size{ 0 }, m_crc{ static_cast<zip_uint32_t>(crc32(0L, Z_NULL, 0)) } {}
+
+	zipfs_block_deflate_t::~zipfs_block_deflate_t() {
+		for (std::future<void>& future : m_futures)//.>not finished: background blocks still use m_deflate
+			future.wait();
+	}
+
+	bool zipfs_block_deflate_t::update(const char* data, size_t byte_sz) {
+		while (byte_sz != 0) {
+			if (m_fill.empty() || m_fill.back().data.size() == m_block_sz) {
+				if (m_fill.size() == m_threads) {//.>batch full: deflated while the next one is filled
+					if (!drain())
+						return false;
+					launch(false);
+				}
+				m_fill.emplace_back();
+				m_fill.back().data.reserve(m_block_sz);
+				m_fill.back().dict = m_dict;
+			}
+
+			block_t& block = m_fill.back();
+			size_t len = std::min(byte_sz, m_block_sz - block.data.size());
+			block.data.insert(block.data.end(), data, data + len);
+			if (block.data.size() == m_block_sz)
+				m_dict.assign(block.data.end() - dict_sz, block.data.end());
+
+			m_size += len;
+			data += len;
+			byte_sz -= len;
+		}
+		return true;
+	}
+
+	bool zipfs_block_deflate_t::finish() {
+		if (m_fill.empty())//.>empty input: one empty final block
+			m_fill.emplace_back();
+
+		if (!drain())
+			return false;
+		launch(true);
+		return drain();
+	}
+
+	zip_uint64_t zipfs_block_deflate_t::size() const {
+		return m_size;
+	}
+
+	zip_uint32_t zipfs_block_deflate_t::crc() const {
+		return m_crc;
+	}
+
+	void zipfs_block_deflate_t::launch(bool last) {
+		zipfs_internal_assert(m_futures.empty());
+
+		m_deflate.swap(m_fill);
+		m_fill.clear();
+		for (size_t b = 0; b < m_deflate.size(); b++)
+			m_futures.push_back(std::async(std::launch::async, &zipfs_block_deflate_t::deflate_block, std::ref(m_deflate[b]), m_level, last && b + 1 == m_deflate.size()));
+	}
+
+	bool zipfs_block_deflate_t::drain() {
+		bool ok = true;
+		for (size_t b = 0; b < m_futures.size(); b++) {
+			m_futures[b].wait();
+			block_t& block = m_deflate[b];
+			ok = ok && block.ok && m_sink(block.out.data(), block.out.size());
+			m_crc = static_cast<zip_uint32_t>(crc32_combine(m_crc, block.crc, static_cast<z_off_t>(block.data.size())));
+		}
+		m_futures.clear();
+		m_deflate.clear();
+		return ok;
+	}
+
+	void zipfs_block_deflate_t::deflate_block(block_t& block, int level, bool last) {
+		block.crc = static_cast<zip_uint32_t>(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(block.data.data()), static_cast<uInt>(block.data.size())));
+
+		z_stream strm{};
+		if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)//-15: raw deflate, as stored in zip entries
+			return;
+		else if (!block.dict.empty() && deflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(block.dict.data()), static_cast<uInt>(block.dict.size())) != Z_OK) {
+			(void)deflateEnd(&strm);
+			return;
+		}
+
+		//.>not last: Z_SYNC_FLUSH ends on a byte boundary without a final block, so the next block's output follows directly
+		block.out.resize(deflateBound(&strm, static_cast<uLong>(block.data.size())) + 16);
+		strm.next_in = reinterpret_cast<Bytef*>(block.data.data());
+		strm.avail_in = static_cast<uInt>(block.data.size());
+		int ret;
+		do {
+			if (strm.total_out == block.out.size())
+				block.out.resize(block.out.size() * 2);
+			strm.next_out = reinterpret_cast<Bytef*>(block.out.data() + strm.total_out);
+			strm.avail_out = static_cast<uInt>(block.out.size() - strm.total_out);
+			ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+		} while (ret == Z_OK && (last || strm.avail_out == 0));
+
+		block.out.resize(strm.total_out);
+		block.ok = last ? ret == Z_STREAM_END : (ret == Z_OK || (ret == Z_BUF_ERROR && strm.avail_in == 0));
+		(void)deflateEnd(&strm);
+	}
+}
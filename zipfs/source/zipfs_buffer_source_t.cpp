@@ -0,0 +1,252 @@
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <algorithm>
+
+namespace zipfs {
+
+	zipfs_buffer_source_t::zipfs_buffer_source_t(const zipfs_buffer_t& buffer) :
+		m_buffer{ buffer }, m_write_offset{ 0 }, m_read_offset{ 0 }, m_memory_budget{ 0 }, m_write_heap_size{ 0 }, m_write_spill{ false }, m_write_spill_offset{ 0 }, m_write_spill_size{ 0 } {
+		zip_error_init(&m_error);
+	}
+
+	zipfs_buffer_source_t::~zipfs_buffer_source_t() {
+		zip_error_fini(&m_error);
+	}
+
+	zip_source_t* zipfs_buffer_source_t::create(const zipfs_buffer_t& buffer, zipfs_buffer_source_t** result, zip_error_t* error) {
+		zipfs_buffer_source_t* ctx = new zipfs_buffer_source_t(buffer);
+		zip_source_t* zs = zip_source_function_create(&zipfs_buffer_source_t::callback, ctx, error);
+		if (zs == nullptr) {
+			delete ctx;
+			return nullptr;
+		}
+
+		*result = ctx;
+		return zs;
+	}
+
+	const zipfs_buffer_t& zipfs_buffer_source_t::buffer() const {
+		return m_buffer;
+	}
+
+	void zipfs_buffer_source_t::set_memory_budget(zip_uint64_t byte_sz) {
+		m_memory_budget = byte_sz;
+	}
+
+	zip_int64_t zipfs_buffer_source_t::callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		return static_cast<zipfs_buffer_source_t*>(userdata)->command(data, len, cmd);
+	}
+
+	zip_int64_t zipfs_buffer_source_t::command(void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		switch (cmd) {
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(
+				ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE,
+				ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS,
+				ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_BEGIN_WRITE_CLONING, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE,
+				ZIP_SOURCE_WRITE, ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_REMOVE, -1);
+
+		//.>read
+		case ZIP_SOURCE_OPEN:
+			m_read_offset = 0;
+			return 0;
+
+		case ZIP_SOURCE_READ: {
+			zip_uint64_t read = m_buffer.read(m_read_offset, static_cast<char*>(data), len);
+			m_read_offset += read;
+			return static_cast<zip_int64_t>(read);
+		}
+
+		case ZIP_SOURCE_CLOSE:
+			return 0;
+
+		case ZIP_SOURCE_STAT: {
+			zip_stat_t* st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &m_error);
+			if (st == nullptr)
+				return -1;
+
+			zip_stat_init(st);
+			st->size = m_buffer.size();
+			st->comp_size = m_buffer.size();
+			st->comp_method = ZIP_CM_STORE;
+			st->encryption_method = ZIP_EM_NONE;
+			st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+			return sizeof(*st);
+		}
+
+		case ZIP_SOURCE_SEEK: {
+			zip_int64_t offset = zip_source_seek_compute_offset(m_read_offset, m_buffer.size(), data, len, &m_error);
+			if (offset < 0)
+				return -1;
+
+			m_read_offset = static_cast<zip_uint64_t>(offset);
+			return 0;
+		}
+
+		case ZIP_SOURCE_TELL:
+			return static_cast<zip_int64_t>(m_read_offset);
+
+		//.>write
+		case ZIP_SOURCE_BEGIN_WRITE:
+			m_write_prefix = zipfs_buffer_t();
+			m_write_data.clear();
+			m_write_offset = 0;
+			m_write_heap_size = m_buffer.heap_size();
+			m_write_spill = false;
+			return 0;
+
+		case ZIP_SOURCE_BEGIN_WRITE_CLONING://.>libzip only rewrites the archive from offset len on
+			if (len > m_buffer.size())
+				return error(ZIP_ER_INVAL);
+
+			m_write_prefix = m_buffer.prefix(len);
+			m_write_data.clear();
+			m_write_offset = len;
+			m_write_heap_size = m_buffer.heap_size();
+			m_write_spill = false;
+			return 0;
+
+		case ZIP_SOURCE_WRITE: {
+			zipfs_internal_assert(m_write_offset >= m_write_prefix.size());
+			zip_uint64_t offset = m_write_offset - m_write_prefix.size();
+			const char* data_ = static_cast<const char*>(data);
+
+			if (!m_write_spill && m_memory_budget != 0 && m_write_heap_size + std::max<zip_uint64_t>(m_write_data.size(), offset + len) > m_memory_budget && !spill_write_data())
+				return -1;
+
+			if (m_write_spill) {
+				if (!m_spill_file->write(m_write_spill_offset + offset, data_, len))
+					return error(ZIP_ER_WRITE);
+				m_write_spill_size = std::max(m_write_spill_size, offset + len);
+			}
+			else {
+				if (offset + len > m_write_data.size())
+					m_write_data.resize(offset + len);
+				std::copy(data_, data_ + len, m_write_data.begin() + offset);
+			}
+
+			m_write_offset += len;
+			return static_cast<zip_int64_t>(len);
+		}
+
+		case ZIP_SOURCE_SEEK_WRITE: {
+			zip_int64_t offset = zip_source_seek_compute_offset(m_write_offset, m_write_prefix.size() + write_size(), data, len, &m_error);
+			if (offset < 0)
+				return -1;
+			else if (static_cast<zip_uint64_t>(offset) < m_write_prefix.size())//the prefix is shared, it can't be written
+				return error(ZIP_ER_INVAL);
+
+			m_write_offset = static_cast<zip_uint64_t>(offset);
+			return 0;
+		}
+
+		case ZIP_SOURCE_TELL_WRITE:
+			return static_cast<zip_int64_t>(m_write_offset);
+
+		case ZIP_SOURCE_COMMIT_WRITE: {
+			zipfs_buffer_t buffer = m_write_prefix;
+			if (m_write_spill) {
+				zipfs_buffer_t::segment_t segment;
+				if (m_write_spill_size != 0 && !m_spill_file->map(m_write_spill_offset, m_write_spill_size, segment))
+					return error(ZIP_ER_WRITE);
+				buffer.append(segment);
+			}
+			else {
+				buffer.append(std::move(m_write_data));
+			}
+
+			if (m_memory_budget != 0 && buffer.heap_size() > m_memory_budget && !spill(buffer))
+				return -1;
+
+			m_buffer = buffer;
+			m_write_prefix = zipfs_buffer_t();
+			m_write_data = {};
+			m_write_spill = false;
+			return 0;
+		}
+
+		case ZIP_SOURCE_ROLLBACK_WRITE:
+			m_write_prefix = zipfs_buffer_t();
+			m_write_data = {};
+			m_write_spill = false;
+			return 0;
+
+		case ZIP_SOURCE_REMOVE:
+			m_buffer = zipfs_buffer_t();
+			return 0;
+
+		//.>lifetime
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&m_error, data, len);
+
+		case ZIP_SOURCE_FREE:
+			delete this;
+			return 0;
+
+		default:
+			return error(ZIP_ER_OPNOTSUPP);
+		}
+	}
+
+	zip_int64_t zipfs_buffer_source_t::error(int ze) {
+		zip_error_set(&m_error, ze, 0);
+		return -1;
+	}
+
+	zip_uint64_t zipfs_buffer_source_t::write_size() const {
+		return m_write_spill ? m_write_spill_size : m_write_data.size();
+	}
+
+	bool zipfs_buffer_source_t::spill_write_data() {//.>data written so far moves to a new region of the spill file, next writes go there too
+		if (m_spill_file == nullptr && (m_spill_file = zipfs_spill_file_t::create()) == nullptr) {
+			(void)error(ZIP_ER_TMPOPEN);
+			return false;
+		}
+
+		m_write_spill_offset = m_spill_file->region();
+		if (!m_spill_file->write(m_write_spill_offset, m_write_data.data(), m_write_data.size())) {
+			(void)error(ZIP_ER_WRITE);
+			return false;
+		}
+
+		m_write_spill_size = m_write_data.size();
+		m_write_data = {};
+		m_write_spill = true;
+		return true;
+	}
+
+	bool zipfs_buffer_source_t::spill(zipfs_buffer_t& buffer) {//.>heap segments of buffer move to the spill file, consecutive ones to a single region
+		if (m_spill_file == nullptr && (m_spill_file = zipfs_spill_file_t::create()) == nullptr) {
+			(void)error(ZIP_ER_TMPOPEN);
+			return false;
+		}
+
+		const std::vector<zipfs_buffer_t::segment_t>& segments = buffer.segments();
+		zipfs_buffer_t spilled;
+		for (size_t s = 0; s < segments.size();) {
+			if (!segments[s].heap) {
+				spilled.append(segments[s++]);
+				continue;
+			}
+
+			zip_uint64_t offset = m_spill_file->region(), size = 0;
+			for (; s < segments.size() && segments[s].heap; s++) {
+				if (!m_spill_file->write(offset + size, segments[s].data.get(), segments[s].size)) {
+					(void)error(ZIP_ER_WRITE);
+					return false;
+				}
+				size += segments[s].size;
+			}
+
+			zipfs_buffer_t::segment_t segment;
+			if (!m_spill_file->map(offset, size, segment)) {
+				(void)error(ZIP_ER_WRITE);
+				return false;
+			}
+			spilled.append(segment);
+		}
+
+		buffer = spilled;
+		return true;
+	}
+}
@@ -0,0 +1,216 @@
+#include <zipfs/zipfs_buffer_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace zipfs {
+
+	zipfs_buffer_t::zipfs_buffer_t() :
+		m_offsets{ 0 } {}
+
+	zipfs_buffer_t::zipfs_buffer_t(std::vector<char>&& data) : zipfs_buffer_t() {
+		append(std::move(data));
+	}
+
+	zipfs_buffer_t::zipfs_buffer_t(const char* data, size_t byte_sz) : zipfs_buffer_t() {
+		if (data != nullptr && byte_sz != 0)
+			append(std::vector<char>{ data, data + byte_sz });
+	}
+
+	zipfs_buffer_t::zipfs_buffer_t(std::shared_ptr<const char> data, zip_uint64_t byte_sz) : zipfs_buffer_t() {
+		if (data != nullptr)
+			append(segment_t{ std::move(data), byte_sz });
+	}
+
+	bool zipfs_buffer_t::map(const filesystem_path_t& fs_path, zipfs_buffer_t& result) {
+		result = zipfs_buffer_t();
+#ifdef _WIN32
+		HANDLE file = CreateFileW(fs_path.platform_path().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER byte_sz;
+		if (!GetFileSizeEx(file, &byte_sz)) {
+			CloseHandle(file);
+			return false;
+		}
+		else if (byte_sz.QuadPart == 0) {//.>can't map an empty file
+			CloseHandle(file);
+			return true;
+		}
+
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr)
+			return false;
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == nullptr)
+			return false;
+
+		std::shared_ptr<const char> data_{ static_cast<const char*>(data), [](const char* p) { UnmapViewOfFile(p); } };
+		result.append(segment_t{ std::move(data_), static_cast<zip_uint64_t>(byte_sz.QuadPart) });
+		return true;
+#else
+		int fd = open(fs_path.platform_path().c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			return false;
+		}
+		else if (st.st_size == 0) {//.>can't map an empty file
+			close(fd);
+			return true;
+		}
+
+		size_t byte_sz = static_cast<size_t>(st.st_size);
+		void* data = mmap(nullptr, byte_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);//.>the mapping keeps the file
+		if (data == MAP_FAILED)
+			return false;
+
+		std::shared_ptr<const char> data_{ static_cast<const char*>(data), [byte_sz](const char* p) { munmap(const_cast<char*>(p), byte_sz); } };
+		result.append(segment_t{ std::move(data_), byte_sz });
+		return true;
+#endif
+	}
+
+	zip_uint64_t zipfs_buffer_t::size() const {
+		return m_offsets.back();
+	}
+
+	zip_uint64_t zipfs_buffer_t::heap_size() const {
+		zip_uint64_t heap_size_ = 0;
+		for (const segment_t& segment : m_segments)
+			if (segment.heap)
+				heap_size_ += segment.size;
+		return heap_size_;
+	}
+
+	bool zipfs_buffer_t::empty() const {
+		return size() == 0;
+	}
+
+	const std::vector<zipfs_buffer_t::segment_t>& zipfs_buffer_t::segments() const {
+		return m_segments;
+	}
+
+	zip_uint64_t zipfs_buffer_t::read(zip_uint64_t offset, char* buf, zip_uint64_t len) const {
+		if (offset >= size())
+			return 0;
+
+		//first segment holding offset
+		size_t s = std::upper_bound(m_offsets.begin(), m_offsets.end(), offset) - m_offsets.begin() - 1;
+
+		zip_uint64_t read = 0;
+		for (; s < m_segments.size() && read < len; s++) {
+			zip_uint64_t segment_offset = offset + read - m_offsets[s];
+			zip_uint64_t n = std::min(len - read, m_segments[s].size - segment_offset);
+			std::memcpy(buf + read, m_segments[s].data.get() + segment_offset, n);
+			read += n;
+		}
+		return read;
+	}
+
+	bool zipfs_buffer_t::span(zip_uint64_t offset, zip_uint64_t len, std::shared_ptr<const char>& result) const {
+		if (offset >= size() || len > size() - offset)
+			return false;
+
+		size_t s = std::upper_bound(m_offsets.begin(), m_offsets.end(), offset) - m_offsets.begin() - 1;
+		zip_uint64_t segment_offset = offset - m_offsets[s];
+		if (len > m_segments[s].size - segment_offset)
+			return false;
+
+		result = std::shared_ptr<const char>(m_segments[s].data, m_segments[s].data.get() + segment_offset);//.>aliasing: shares the segment's ownership
+		return true;
+	}
+
+	void zipfs_buffer_t::copy_to(std::vector<char>& result) const {
+		result.resize(size());
+		zip_uint64_t read = this->read(0, result.data(), result.size());
+		zipfs_internal_assert(read == result.size());
+	}
+
+	bool zipfs_buffer_t::equals(const zipfs_buffer_t& other) const {
+		if (size() != other.size())
+			return false;
+
+		//shared segments are equal without reading them
+		bool shared = m_segments.size() == other.m_segments.size();
+		for (size_t s = 0; shared && s < m_segments.size(); s++)
+			shared = m_segments[s].data == other.m_segments[s].data && m_segments[s].size == other.m_segments[s].size;
+		if (shared)
+			return true;
+
+		std::vector<char> buf(1 << 16), other_buf(1 << 16);
+		for (zip_uint64_t offset = 0; offset < size(); offset += buf.size()) {
+			zip_uint64_t read = this->read(offset, buf.data(), buf.size());
+			zip_uint64_t other_read = other.read(offset, other_buf.data(), other_buf.size());
+			if (read != other_read || std::memcmp(buf.data(), other_buf.data(), read) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	zipfs_buffer_t zipfs_buffer_t::prefix(zip_uint64_t byte_sz) const {
+		zipfs_internal_assert(byte_sz <= size());
+
+		zipfs_buffer_t prefix_;
+		for (size_t s = 0; s < m_segments.size() && prefix_.size() < byte_sz; s++) {
+			segment_t segment = m_segments[s];
+			segment.size = std::min(segment.size, byte_sz - prefix_.size());
+			prefix_.append(segment);
+		}
+		return prefix_;
+	}
+
+	zipfs_buffer_t zipfs_buffer_t::slice(zip_uint64_t offset, zip_uint64_t byte_sz) const {
+		zipfs_internal_assert(offset <= size() && byte_sz <= size() - offset);
+
+		zipfs_buffer_t slice_;
+		if (byte_sz == 0)
+			return slice_;
+
+		size_t s = std::upper_bound(m_offsets.begin(), m_offsets.end(), offset) - m_offsets.begin() - 1;
+		for (zip_uint64_t segment_offset = offset - m_offsets[s]; slice_.size() < byte_sz; s++, segment_offset = 0) {
+			segment_t segment = m_segments[s];
+			segment.data = std::shared_ptr<const char>(m_segments[s].data, m_segments[s].data.get() + segment_offset);//.>aliasing: shares the segment's ownership
+			segment.size = std::min(segment.size - segment_offset, byte_sz - slice_.size());
+			slice_.append(segment);
+		}
+		return slice_;
+	}
+
+	void zipfs_buffer_t::append(const segment_t& segment) {
+		if (segment.size == 0)
+			return;
+
+		m_segments.push_back(segment);
+		m_offsets.push_back(m_offsets.back() + segment.size);
+	}
+
+	void zipfs_buffer_t::append(std::vector<char>&& data) {
+		if (data.empty())
+			return;
+
+		auto data_ = std::make_shared<const std::vector<char>>(std::move(data));
+		append(segment_t{ std::shared_ptr<const char>{ data_, data_->data() }, data_->size(), true });
+	}
+
+	void zipfs_buffer_t::append(const zipfs_buffer_t& buffer) {
+		for (const segment_t& segment : buffer.m_segments)
+			append(segment);
+	}
+}
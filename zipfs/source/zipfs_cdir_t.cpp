@@ -0,0 +1,295 @@
+#include <zipfs/zipfs_cdir_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <algorithm>
+
+namespace zipfs {
+
+	namespace {
+
+		const zip_uint32_t
+			s_local_header_signature = 0x04034b50,
+			s_data_descriptor_signature = 0x08074b50,
+			s_cdir_record_signature = 0x02014b50,
+			s_eocd_signature = 0x06054b50,
+			s_eocd64_locator_signature = 0x07064b50;
+
+		const zip_uint16_t
+			s_alignment_extra_field_id = 0xd935;//.>zipalign: 2 bytes alignment, then zero padding
+
+		const zip_uint64_t
+			s_local_header_size = 30,
+			s_cdir_record_size = 46,
+			s_eocd_size = 22,
+			s_eocd64_locator_size = 20,
+			s_comment_max_size = 0xffff;
+
+		zip_uint32_t get_16(const char* data) {
+			const unsigned char* d = reinterpret_cast<const unsigned char*>(data);
+			return d[0] | (d[1] << 8);
+		}
+
+		zip_uint32_t get_32(const char* data) {
+			const unsigned char* d = reinterpret_cast<const unsigned char*>(data);
+			return d[0] | (d[1] << 8) | (d[2] << 16) | (static_cast<zip_uint32_t>(d[3]) << 24);
+		}
+
+		void put_16(char* data, zip_uint32_t value) {
+			data[0] = static_cast<char>(value & 0xff);
+			data[1] = static_cast<char>((value >> 8) & 0xff);
+		}
+
+		void put_32(char* data, zip_uint32_t value) {
+			put_16(data, value & 0xffff);
+			put_16(data + 2, value >> 16);
+		}
+	}
+
+	zip_uint64_t zipfs_cdir_t::record_t::local_header_offset() const {
+		return get_32(m_data.data() + 42);
+	}
+
+	void zipfs_cdir_t::record_t::set_local_header_offset(zip_uint64_t offset) {
+		zipfs_internal_assert(offset < 0xffffffff);
+		put_32(m_data.data() + 42, static_cast<zip_uint32_t>(offset));
+	}
+
+	zip_uint64_t zipfs_cdir_t::record_t::compressed_size() const {
+		return get_32(m_data.data() + 20);
+	}
+
+	zip_uint32_t zipfs_cdir_t::record_t::crc() const {
+		return get_32(m_data.data() + 16);
+	}
+
+	zip_uint32_t zipfs_cdir_t::record_t::flags() const {
+		return get_16(m_data.data() + 8);
+	}
+
+	zipfs_cdir_t::zipfs_cdir_t() :
+		m_offset{ 0 }, m_size{ 0 } {}
+
+	bool zipfs_cdir_t::parse(const zipfs_buffer_t& buffer) {
+		m_records.clear();
+		m_comment.clear();
+
+		if (buffer.size() < s_eocd_size)
+			return false;
+
+		//.>end of central directory record: last signature whose comment ends the archive
+		zip_uint64_t tail_offset = buffer.size() - std::min(buffer.size(), s_eocd_size + s_comment_max_size);
+		std::vector<char> tail(buffer.size() - tail_offset);
+		buffer.read(tail_offset, tail.data(), tail.size());
+
+		zip_uint64_t eocd = tail.size() - s_eocd_size;
+		for (;; eocd--) {
+			if (get_32(tail.data() + eocd) == s_eocd_signature && eocd + s_eocd_size + get_16(tail.data() + eocd + 20) == tail.size())
+				break;
+			else if (eocd == 0)
+				return false;
+		}
+
+		const char* e = tail.data() + eocd;
+		zip_uint32_t num_records = get_16(e + 10);
+		if (get_16(e + 4) != 0 || get_16(e + 6) != 0 || get_16(e + 8) != num_records)//multi-disk
+			return false;
+		else if (num_records == 0xffff || get_32(e + 12) == 0xffffffff || get_32(e + 16) == 0xffffffff)//zip64
+			return false;
+		else if (eocd >= s_eocd64_locator_size && get_32(e - s_eocd64_locator_size) == s_eocd64_locator_signature)//zip64
+			return false;
+
+		m_size = get_32(e + 12);
+		m_offset = get_32(e + 16);
+		m_comment.assign(e + s_eocd_size, e + s_eocd_size + get_16(e + 20));
+		if (m_offset + m_size != tail_offset + eocd)//.>data between the central directory and its end record
+			return false;
+
+		//.>central directory records
+		std::vector<char> cdir(m_size);
+		buffer.read(m_offset, cdir.data(), cdir.size());
+
+		m_records.reserve(num_records);
+		for (zip_uint64_t r = 0; r < cdir.size();) {
+			const char* c = cdir.data() + r;
+			if (cdir.size() - r < s_cdir_record_size || get_32(c) != s_cdir_record_signature)
+				return false;
+
+			zip_uint64_t record_size = s_cdir_record_size + get_16(c + 28) + get_16(c + 30) + get_16(c + 32);
+			if (cdir.size() - r < record_size)
+				return false;
+			else if (get_32(c + 20) == 0xffffffff || get_32(c + 24) == 0xffffffff || get_32(c + 42) == 0xffffffff || get_16(c + 34) != 0)//zip64, multi-disk
+				return false;
+
+			record_t record;
+			record.m_data.assign(c, c + record_size);
+			m_records.push_back(std::move(record));
+			r += record_size;
+		}
+
+		return m_records.size() == num_records;
+	}
+
+	const std::vector<zipfs_cdir_t::record_t>& zipfs_cdir_t::records() const {
+		return m_records;
+	}
+
+	zip_uint64_t zipfs_cdir_t::offset() const {
+		return m_offset;
+	}
+
+	zip_uint64_t zipfs_cdir_t::size() const {
+		return m_size;
+	}
+
+	bool zipfs_cdir_t::data_offset(const zipfs_buffer_t& buffer, const record_t& record, zip_uint64_t& result) {
+		zip_uint64_t offset = record.local_header_offset();
+		char local_header[s_local_header_size];
+		if (buffer.read(offset, local_header, s_local_header_size) != s_local_header_size || get_32(local_header) != s_local_header_signature)
+			return false;
+
+		result = offset + s_local_header_size + get_16(local_header + 26) + get_16(local_header + 28);
+		return result + record.compressed_size() <= buffer.size();
+	}
+
+	bool zipfs_cdir_t::entry_size(const zipfs_buffer_t& buffer, const record_t& record, zip_uint64_t& result) {
+		zip_uint64_t offset = record.local_header_offset();
+		if (!data_offset(buffer, record, result))
+			return false;
+
+		result = result - offset + record.compressed_size();
+		if (record.flags() & 0x0008) {//.>data descriptor, signature is optional
+			char signature[4];
+			if (buffer.read(offset + result, signature, 4) != 4)
+				return false;
+			result += get_32(signature) == s_data_descriptor_signature ? 16 : 12;
+		}
+
+		return offset + result <= buffer.size();
+	}
+
+	const std::vector<char>& zipfs_cdir_t::comment() const {
+		return m_comment;
+	}
+
+	bool zipfs_cdir_t::align(const zipfs_buffer_t& buffer, zip_uint64_t alignment, zipfs_buffer_t& result) {
+		zipfs_internal_assert(alignment != 0 && alignment <= 0x8000);
+
+		zipfs_cdir_t cdir;
+		if (!cdir.parse(buffer))
+			return false;
+
+		auto aligned = [](const record_t& record) {//.>stored, unencrypted
+			return get_16(record.m_data.data() + 10) == ZIP_CM_STORE && !(record.flags() & 0x0001);
+		};
+
+		//.>entries by data order; the archive is rewritten from the first misaligned one on
+		std::vector<size_t> order(cdir.m_records.size());
+		for (size_t r = 0; r < order.size(); r++)
+			order[r] = r;
+		std::sort(order.begin(), order.end(), [&cdir](size_t l, size_t r) { return cdir.m_records[l].local_header_offset() < cdir.m_records[r].local_header_offset(); });
+
+		size_t first = 0;
+		for (; first < order.size(); first++) {
+			const record_t& record = cdir.m_records[order[first]];
+			zip_uint64_t offset;
+			if (!data_offset(buffer, record, offset))
+				return false;
+			else if (aligned(record) && offset % alignment != 0)
+				break;
+		}
+		if (first == order.size())
+			return false;
+
+		//.>rewritten local headers, the data and data descriptors shared with buffer
+		zip_uint64_t offset = cdir.m_records[order[first]].local_header_offset();
+		zipfs_buffer_t data;
+		for (size_t o = first; o < order.size(); o++) {
+			record_t& record = cdir.m_records[order[o]];
+			zip_uint64_t size, header_offset = record.local_header_offset();
+			char local_header[s_local_header_size];
+			if (!entry_size(buffer, record, size) || buffer.read(header_offset, local_header, s_local_header_size) != s_local_header_size)
+				return false;
+
+			zip_uint32_t name_size = get_16(local_header + 26), extra_size = get_16(local_header + 28);
+			std::vector<char> header(s_local_header_size + name_size + extra_size);
+			buffer.read(header_offset, header.data(), header.size());
+			const char* extra = header.data() + s_local_header_size + name_size;
+
+			//.>local extra fields, less a previous alignment field; left as is if malformed
+			std::vector<char> fields;
+			bool well_formed = true;
+			for (zip_uint32_t f = 0; well_formed && f < extra_size;) {
+				well_formed = extra_size - f >= 4 && extra_size - f - 4 >= get_16(extra + f + 2);
+				if (well_formed) {
+					zip_uint32_t field_size = 4 + get_16(extra + f + 2);
+					if (get_16(extra + f) != s_alignment_extra_field_id)
+						fields.insert(fields.end(), extra + f, extra + f + field_size);
+					f += field_size;
+				}
+			}
+
+			if (aligned(record) && well_formed) {
+				zip_uint64_t header_size = s_local_header_size + name_size + fields.size() + 6;
+				zip_uint64_t padding = (alignment - (offset + data.size() + header_size) % alignment) % alignment;
+				if (fields.size() + 6 + padding > 0xffff)
+					return false;
+
+				char field[6];
+				put_16(field, s_alignment_extra_field_id);
+				put_16(field + 2, static_cast<zip_uint32_t>(2 + padding));
+				put_16(field + 4, static_cast<zip_uint32_t>(alignment));
+				fields.insert(fields.end(), field, field + 6);
+				fields.resize(fields.size() + padding, 0);
+
+				put_16(header.data() + 28, static_cast<zip_uint32_t>(fields.size()));
+				header.resize(s_local_header_size + name_size);
+				header.insert(header.end(), fields.begin(), fields.end());
+			}
+
+			if (offset + data.size() >= 0xffffffff)
+				return false;
+			record.set_local_header_offset(offset + data.size());
+			if (aligned(record) && well_formed) {
+				zip_uint64_t old_header_size = s_local_header_size + name_size + extra_size;
+				data.append(std::move(header));
+				data.append(buffer.slice(header_offset + old_header_size, size - old_header_size));
+			}
+			else {//.>moved as is
+				data.append(buffer.slice(header_offset, size));
+			}
+		}
+
+		std::vector<char> cdir_data;
+		if (!write(cdir.m_records, offset + data.size(), cdir.m_comment, cdir_data))
+			return false;
+
+		result = buffer.prefix(offset);
+		result.append(data);
+		result.append(std::move(cdir_data));
+		return true;
+	}
+
+	bool zipfs_cdir_t::write(const std::vector<record_t>& records, zip_uint64_t offset, const std::vector<char>& comment, std::vector<char>& result) {
+		zip_uint64_t size = 0;
+		for (const record_t& record : records)
+			size += record.m_data.size();
+
+		if (records.size() >= 0xffff || offset >= 0xffffffff || size >= 0xffffffff || offset + size >= 0xffffffff || comment.size() > s_comment_max_size)
+			return false;
+
+		result.clear();
+		result.reserve(size + s_eocd_size + comment.size());
+		for (const record_t& record : records)
+			result.insert(result.end(), record.m_data.begin(), record.m_data.end());
+
+		char eocd[s_eocd_size] = {};
+		put_32(eocd, s_eocd_signature);
+		put_16(eocd + 8, static_cast<zip_uint32_t>(records.size()));
+		put_16(eocd + 10, static_cast<zip_uint32_t>(records.size()));
+		put_32(eocd + 12, static_cast<zip_uint32_t>(size));
+		put_32(eocd + 16, static_cast<zip_uint32_t>(offset));
+		put_16(eocd + 20, static_cast<zip_uint32_t>(comment.size()));
+		result.insert(result.end(), eocd, eocd + s_eocd_size);
+		result.insert(result.end(), comment.begin(), comment.end());
+		return true;
+	}
+}
@@ -0,0 +1,159 @@
+#include <zipfs/zipfs_cipher_source_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <algorithm>
+#include <cstring>
+
+namespace zipfs {
+
+	namespace {
+
+		const size_t
+			s_chunk_size = 1 << 16;
+	}
+
+	zipfs_cipher_source_t::zipfs_cipher_source_t(zip_source_t* src, const zipfs_cipher_t& cipher, const char* filename, std::string* failed) :
+		m_src{ src }, m_cipher{ cipher }, m_filename{ filename }, m_failed{ failed }, m_state{ nullptr }, m_out_offset{ 0 }, m_final{ false } {
+		zip_error_init(&m_error);
+	}
+
+	zipfs_cipher_source_t::~zipfs_cipher_source_t() {
+		release();
+		(void)zip_source_free(m_src);
+		zip_error_fini(&m_error);
+	}
+
+	zip_source_t* zipfs_cipher_source_t::create(zip_source_t* src, const zipfs_cipher_t& cipher, const char* filename, std::string* failed, zip_error_t* error) {
+		zipfs_internal_assert(cipher.is_set());
+
+		zipfs_cipher_source_t* ctx = new zipfs_cipher_source_t(src, cipher, filename, failed);
+		zip_source_t* zs = zip_source_function_create(&zipfs_cipher_source_t::callback, ctx, error);
+		if (zs == nullptr) {
+			delete ctx;
+			return nullptr;
+		}
+
+		return zs;
+	}
+
+	zip_int64_t zipfs_cipher_source_t::callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		return static_cast<zipfs_cipher_source_t*>(userdata)->command(data, len, cmd);
+	}
+
+	zip_int64_t zipfs_cipher_source_t::command(void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		switch (cmd) {
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(
+				ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, -1);
+
+		case ZIP_SOURCE_OPEN:
+			release();
+			if (zip_source_open(m_src) == -1)
+				return src_error();
+			else if ((m_state = m_cipher.init(m_cipher.context, m_filename.c_str())) == nullptr) {
+				(void)zip_source_close(m_src);
+				return cipher_error();
+			}
+			m_out.clear();
+			m_out_offset = 0;
+			m_final = false;
+			return 0;
+
+		case ZIP_SOURCE_READ: {
+			char* out = static_cast<char*>(data);
+			zip_uint64_t read = 0;
+			while (read < len) {
+				if (m_out_offset == m_out.size()) {//.>next chunk
+					if (m_final)
+						break;
+
+					m_out.clear();
+					m_out_offset = 0;
+					m_in.resize(s_chunk_size);
+					zip_int64_t in = zip_source_read(m_src, m_in.data(), m_in.size());
+					if (in < 0)
+						return src_error();
+
+					bool ok;
+					if (in > 0)
+						ok = m_cipher.update(m_state, reinterpret_cast<const uint8_t*>(m_in.data()), static_cast<size_t>(in), m_out);
+					else {
+						ok = m_cipher.final(m_state, m_out);//.>releases the state
+						m_state = nullptr;
+						m_final = true;
+					}
+					if (!ok)
+						return cipher_error();
+					continue;
+				}
+
+				zip_uint64_t n = std::min<zip_uint64_t>(len - read, m_out.size() - m_out_offset);
+				std::memcpy(out + read, m_out.data() + m_out_offset, static_cast<size_t>(n));
+				m_out_offset += static_cast<size_t>(n);
+				read += n;
+			}
+			return static_cast<zip_int64_t>(read);
+		}
+
+		case ZIP_SOURCE_CLOSE:
+			release();
+			(void)zip_source_close(m_src);
+			return 0;
+
+		case ZIP_SOURCE_STAT: {//.>size unknown until read; the lower source's mtime is kept
+			zip_stat_t* st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &m_error);
+			if (st == nullptr)
+				return -1;
+
+			zip_stat_t src_st;
+			zip_stat_init(&src_st);
+			if (zip_source_stat(m_src, &src_st) == -1)
+				return src_error();
+
+			zip_stat_init(st);
+			if (src_st.valid & ZIP_STAT_MTIME) {
+				st->mtime = src_st.mtime;
+				st->valid |= ZIP_STAT_MTIME;
+			}
+			st->comp_method = ZIP_CM_STORE;
+			st->encryption_method = ZIP_EM_NONE;
+			st->valid |= ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+			return sizeof(*st);
+		}
+
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&m_error, data, len);
+
+		case ZIP_SOURCE_FREE:
+			delete this;
+			return 0;
+
+		default:
+			return error(ZIP_ER_OPNOTSUPP);
+		}
+	}
+
+	zip_int64_t zipfs_cipher_source_t::error(int ze) {
+		zip_error_set(&m_error, ze, 0);
+		return -1;
+	}
+
+	zip_int64_t zipfs_cipher_source_t::src_error() {
+		zip_error_t* ze = zip_source_error(m_src);
+		zip_error_set(&m_error, zip_error_code_zip(ze), zip_error_code_system(ze));
+		return -1;
+	}
+
+	zip_int64_t zipfs_cipher_source_t::cipher_error() {//.>libzip only sees an internal error
+		if (m_failed != nullptr)
+			*m_failed = m_filename;
+		return error(ZIP_ER_INTERNAL);
+	}
+
+	void zipfs_cipher_source_t::release() {//.>final() releases the state of an unfinished file
+		if (m_state != nullptr) {
+			std::vector<char> discard;
+			(void)m_cipher.final(m_state, discard);
+			m_state = nullptr;
+		}
+	}
+}
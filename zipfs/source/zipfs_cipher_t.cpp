@@ -0,0 +1,14 @@
+#include <zipfs/zipfs_cipher_t.h>
+
+namespace zipfs {
+
+	zipfs_cipher_t::zipfs_cipher_t() :
+		context{ nullptr }, init{ nullptr }, update{ nullptr }, final{ nullptr } {}
+
+	zipfs_cipher_t::zipfs_cipher_t(void* context, init_func init, update_func update, final_func final) :
+		context{ context }, init{ init }, update{ update }, final{ final } {}
+
+	bool zipfs_cipher_t::is_set() const {
+		return init != nullptr && update != nullptr && final != nullptr;
+	}
+}
@@ -0,0 +1,87 @@
+#include <zipfs/zipfs_deflate_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zlib.h>
+#include <algorithm>
+
+namespace zipfs {
+
+	zipfs_deflate_t::zipfs_deflate_t() :
+		m_strm{ nullptr }, m_size{ 0 }, m_crc{ 0 } {}
+
+	zipfs_deflate_t::~zipfs_deflate_t() {
+		if (m_strm != nullptr)
+			(void)deflateEnd(m_strm.get());
+	}
+
+	bool zipfs_deflate_t::init(int level) {
+		if (m_strm != nullptr)
+			(void)deflateEnd(m_strm.get());
+
+		m_strm.reset(new z_stream{});
+		m_size = 0;
+		m_crc = static_cast<zip_uint32_t>(crc32(0L, Z_NULL, 0));
+		if (deflateInit2(m_strm.get(), level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {//-15: raw deflate, as stored in zip entries
+			m_strm.reset();
+			return false;
+		}
+		return true;
+	}
+
+	bool zipfs_deflate_t::update(const char* data, size_t byte_sz, std::vector<char>& out) {
+		zipfs_internal_assert(m_strm != nullptr);
+
+		while (byte_sz != 0) {
+			uInt len = static_cast<uInt>(std::min<size_t>(byte_sz, 1u << 30));
+			m_crc = static_cast<zip_uint32_t>(crc32(m_crc, reinterpret_cast<const Bytef*>(data), len));
+			m_size += len;
+
+			m_strm->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			m_strm->avail_in = len;
+			do {
+				size_t at = out.size();
+				out.resize(at + (1 << 16));
+				m_strm->next_out = reinterpret_cast<Bytef*>(out.data() + at);
+				m_strm->avail_out = 1 << 16;
+				if (deflate(m_strm.get(), Z_NO_FLUSH) == Z_STREAM_ERROR)
+					return false;
+				out.resize(out.size() - m_strm->avail_out);
+			} while (m_strm->avail_in != 0);
+
+			data += len;
+			byte_sz -= len;
+		}
+		return true;
+	}
+
+	bool zipfs_deflate_t::finish(std::vector<char>& out) {
+		zipfs_internal_assert(m_strm != nullptr);
+
+		m_strm->next_in = Z_NULL;
+		m_strm->avail_in = 0;
+		int ret;
+		do {
+			size_t at = out.size();
+			out.resize(at + (1 << 16));
+			m_strm->next_out = reinterpret_cast<Bytef*>(out.data() + at);
+			m_strm->avail_out = 1 << 16;
+			ret = deflate(m_strm.get(), Z_FINISH);
+			out.resize(out.size() - m_strm->avail_out);
+		} while (ret == Z_OK);
+
+		(void)deflateEnd(m_strm.get());
+		m_strm.reset();
+		return ret == Z_STREAM_END;
+	}
+
+	zip_uint64_t zipfs_deflate_t::size() const {
+		return m_size;
+	}
+
+	zip_uint32_t zipfs_deflate_t::crc() const {
+		return m_crc;
+	}
+
+	int zipfs_deflate_t::level(zip_uint32_t compression_flags) {
+		return compression_flags >= 1 && compression_flags <= 9 ? static_cast<int>(compression_flags) : Z_DEFAULT_COMPRESSION;
+	}
+}
@@ -0,0 +1,77 @@
+#include <zipfs/zipfs_deflated_source_t.h>
+#include <zipfs/zipfs_assert.h>
+
+namespace zipfs {
+
+	zipfs_deflated_source_t::zipfs_deflated_source_t(const zipfs_buffer_t& data, zip_int32_t comp_method, zip_uint64_t size, zip_uint32_t crc, time_t mtime) :
+		m_data{ data }, m_comp_method{ comp_method }, m_size{ size }, m_crc{ crc }, m_mtime{ mtime }, m_offset{ 0 } {
+		zip_error_init(&m_error);
+	}
+
+	zipfs_deflated_source_t::~zipfs_deflated_source_t() {
+		zip_error_fini(&m_error);
+	}
+
+	zip_source_t* zipfs_deflated_source_t::create(const zipfs_buffer_t& data, zip_int32_t comp_method, zip_uint64_t size, zip_uint32_t crc, time_t mtime, zip_error_t* error) {
+		zipfs_deflated_source_t* ctx = new zipfs_deflated_source_t(data, comp_method, size, crc, mtime);
+		zip_source_t* zs = zip_source_function_create(&zipfs_deflated_source_t::callback, ctx, error);
+		if (zs == nullptr) {
+			delete ctx;
+			return nullptr;
+		}
+
+		return zs;
+	}
+
+	zip_int64_t zipfs_deflated_source_t::callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		return static_cast<zipfs_deflated_source_t*>(userdata)->command(data, len, cmd);
+	}
+
+	zip_int64_t zipfs_deflated_source_t::command(void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+		switch (cmd) {
+		case ZIP_SOURCE_SUPPORTS:
+			return zip_source_make_command_bitmap(
+				ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, -1);
+
+		case ZIP_SOURCE_OPEN:
+			m_offset = 0;
+			return 0;
+
+		case ZIP_SOURCE_READ: {
+			zip_uint64_t read = m_data.read(m_offset, static_cast<char*>(data), len);
+			m_offset += read;
+			return static_cast<zip_int64_t>(read);
+		}
+
+		case ZIP_SOURCE_CLOSE:
+			return 0;
+
+		case ZIP_SOURCE_STAT: {//.>as zip_source_zip() with ZIP_FL_COMPRESSED: the data is copied, not recompressed
+			zip_stat_t* st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &m_error);
+			if (st == nullptr)
+				return -1;
+
+			zip_stat_init(st);
+			st->size = m_size;
+			st->comp_size = m_data.size();
+			st->comp_method = static_cast<zip_uint16_t>(m_comp_method);
+			st->crc = m_crc;
+			st->mtime = m_mtime;
+			st->encryption_method = ZIP_EM_NONE;
+			st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_MTIME | ZIP_STAT_ENCRYPTION_METHOD;
+			return sizeof(*st);
+		}
+
+		case ZIP_SOURCE_ERROR:
+			return zip_error_to_data(&m_error, data, len);
+
+		case ZIP_SOURCE_FREE:
+			delete this;
+			return 0;
+
+		default:
+			zip_error_set(&m_error, ZIP_ER_OPNOTSUPP, 0);
+			return -1;
+		}
+	}
+}
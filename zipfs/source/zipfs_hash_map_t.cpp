@@ -0,0 +1,117 @@
+#include <zipfs/zipfs_hash_map_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <functional>
+#include <limits>
+
+namespace zipfs {
+
+	bool zipfs_hash_map_t::insert(std::string_view key, zip_int64_t value) {
+		if ((m_size + m_tombstones + 1) * 4 > m_slots.size() * 3)//max load factor .75
+			rehash(m_size + 1 > m_slots.size() / 2 ? m_slots.size() * 2 : m_slots.size());
+
+		uint64_t h = hash(key);
+		if (probe(key, h) != m_slots.size())
+			return false;
+
+		zipfs_internal_assert(m_arena.size() + key.size() <= std::numeric_limits<uint32_t>::max());
+
+		size_t mask = m_slots.size() - 1;
+		size_t s = h & mask;
+		while (m_slots[s].hash != s_empty && m_slots[s].hash != s_tombstone)
+			s = (s + 1) & mask;
+
+		if (m_slots[s].hash == s_tombstone)
+			m_tombstones--;
+
+		m_slots[s] = { h, (uint32_t)m_arena.size(), (uint32_t)key.size(), value };
+		m_arena.insert(m_arena.end(), key.begin(), key.end());
+		m_size++;
+		return true;
+	}
+
+	bool zipfs_hash_map_t::erase(std::string_view key) {
+		if (m_slots.empty())
+			return false;
+
+		size_t s = probe(key, hash(key));
+		if (s == m_slots.size())
+			return false;
+
+		m_arena_garbage += m_slots[s].key_size;
+		m_slots[s].hash = s_tombstone;
+		m_size--;
+		m_tombstones++;
+		return true;
+	}
+
+	zip_int64_t* zipfs_hash_map_t::find(std::string_view key) {
+		return const_cast<zip_int64_t*>(static_cast<const zipfs_hash_map_t*>(this)->find(key));
+	}
+
+	const zip_int64_t* zipfs_hash_map_t::find(std::string_view key) const {
+		if (m_slots.empty())
+			return nullptr;
+
+		size_t s = probe(key, hash(key));
+		return s != m_slots.size() ? &m_slots[s].value : nullptr;
+	}
+
+	void zipfs_hash_map_t::clear() {
+		m_slots.clear();
+		m_arena.clear();
+		m_size = m_tombstones = m_arena_garbage = 0;
+	}
+
+	size_t zipfs_hash_map_t::size() const {
+		return m_size;
+	}
+
+	bool zipfs_hash_map_t::empty() const {
+		return m_size == 0;
+	}
+
+	uint64_t zipfs_hash_map_t::hash(std::string_view key) {
+		uint64_t h = std::hash<std::string_view>{}(key);
+		return h < 2 ? h + 2 : h;//.>0 and 1 are s_empty and s_tombstone
+	}
+
+	size_t zipfs_hash_map_t::probe(std::string_view key, uint64_t h) const {
+		if (m_slots.empty())
+			return 0;
+
+		size_t mask = m_slots.size() - 1;
+		for (size_t s = h & mask; ; s = (s + 1) & mask) {
+			const slot_t& slot = m_slots[s];
+			if (slot.hash == s_empty)
+				return m_slots.size();
+			if (slot.hash == h && slot.key_size == key.size() && std::string_view{ m_arena.data() + slot.key_offset, slot.key_size } == key)
+				return s;
+		}
+	}
+
+	void zipfs_hash_map_t::rehash(size_t slot_count) {//also drops tombstones and compacts the arena
+		slot_count = slot_count < 16 ? 16 : slot_count;
+
+		std::vector<slot_t> slots(slot_count, slot_t{ s_empty, 0, 0, 0 });
+		std::vector<char> arena;
+		arena.reserve(m_arena.size() - m_arena_garbage);
+
+		size_t mask = slot_count - 1;
+		for (const slot_t& slot : m_slots) {
+			if (slot.hash == s_empty || slot.hash == s_tombstone)
+				continue;
+
+			size_t s = slot.hash & mask;
+			while (slots[s].hash != s_empty)
+				s = (s + 1) & mask;
+
+			slots[s] = { slot.hash, (uint32_t)arena.size(), slot.key_size, slot.value };
+			arena.insert(arena.end(), m_arena.begin() + slot.key_offset, m_arena.begin() + slot.key_offset + slot.key_size);
+		}
+
+		m_slots = std::move(slots);
+		m_arena = std::move(arena);
+		m_tombstones = 0;
+		m_arena_garbage = 0;
+	}
+}
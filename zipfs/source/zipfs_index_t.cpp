@@ -1,12 +1,19 @@
 #include <zipfs/zipfs_index_t.h>
+#include <zipfs/zipfs_hash_map_t.h>
 #include <zipfs/zipfs_assert.h>
 #include <zipfs/zipfs_zip_flags.h>
+#include <algorithm>
 
 namespace zipfs {
 
+	zipfs_index_t::zipfs_index_t() :
+		m_map{ new decltype(m_map)::element_type() } {}
+
+	zipfs_index_t::~zipfs_index_t() {}
+
 	bool zipfs_index_t::init(zip_t* z) {
 		zipfs_internal_assert(z != nullptr);
-		zipfs_internal_assert(m_map.empty());
+		zipfs_internal_assert(m_map->empty());
 
 		zip_int64_t num_entries = zip_get_num_entries(z, ZIPFS_ZIP_FLAGS_NONE);
 		if (num_entries == -1)
@@ -14,43 +21,97 @@ namespace zipfs {
 
 		for (zip_int64_t e = 0; e < num_entries; e++) {
 			const char* name = zip_get_name(z, e, ZIPFS_ZIP_FL_ENC);
-			if (name == nullptr)
-				zipfs_internal_assert(false);
+			if (name == nullptr) {//entry was deleted or reverted while the archive is open (session)
+				zip_error_clear(z);
+				continue;
+			}
 
-			auto insert = m_map.insert({ "/" + std::string(name), e });
-			zipfs_internal_assert(insert.second);
+			zipfs_path_t zipfs_path = "/" + std::string(name);
+			bool insert = map_insert(zipfs_path, e);
+			zipfs_internal_assert(insert);
+			m_tree.insert(zipfs_path);
 		}
+
+		m_is_init = true;
 		return true;
 	}
 
+	bool zipfs_index_t::is_init() const {
+		return m_is_init;
+	}
+
+	void zipfs_index_t::commit() {//archive was written: shift indexes down past the deleted entries
+		if (m_deleted.empty())
+			return;
+
+		std::sort(m_deleted.begin(), m_deleted.end());
+		auto shift = [this](zip_int64_t& index) {
+			index -= std::lower_bound(m_deleted.begin(), m_deleted.end(), index) - m_deleted.begin();
+		};
+#if ZIPFS_INDEX_T_HASH_MAP
+		m_map->for_each([&shift](std::string_view, zip_int64_t& index) { shift(index); });
+#else
+		for (auto& entry : *m_map)
+			shift(entry.second);
+#endif
+		m_deleted.clear();
+	}
+
 	bool zipfs_index_t::verify(zip_t* z) const {
 		zipfs_internal_assert(z != nullptr);
 
 		zip_int64_t num_entries = zip_get_num_entries(z, ZIPFS_ZIP_FLAGS_NONE);
-		if (num_entries == -1 || num_entries != m_map.size())
+		if (num_entries == -1)
 			return false;
 
+		size_t num_names = 0;
 		for (zip_int64_t e = 0; e < num_entries; e++) {
 			const char* name = zip_get_name(z, e, ZIPFS_ZIP_FL_ENC);
-			if (name == nullptr)
-				zipfs_internal_assert(false);
+			if (name == nullptr) {//entry was deleted or reverted while the archive is open (session)
+				zip_error_clear(z);
+				continue;
+			}
+			num_names++;
 
-			auto find = m_map.find("/" + std::string(name));
-			if (find == m_map.end())
+			const zip_int64_t* find = map_find("/" + std::string(name));
+			if (find == nullptr)
 				return false;
-			else if (find->second != e)
+			else if (*find != e)
 				return false;
 		}
 
-		return true;
+		return num_names == m_map->size();
 	}
 
 	bool zipfs_index_t::rename(const zipfs_path_t& zipfs_path, const zipfs_path_t& zipfs_rename_path) {
-		auto find = m_map.find(zipfs_path);
-		if (find != m_map.end()) {
-			auto erase = m_map.erase(find);
-			auto insert = m_map.insert({ zipfs_rename_path, erase->second });
-			zipfs_internal_assert(insert.second);
+		const zip_int64_t* find = map_find(zipfs_path);
+		if (find != nullptr) {
+			zip_int64_t index = *find;
+			map_erase(zipfs_path);
+			bool insert = map_insert(zipfs_rename_path, index);
+			zipfs_internal_assert(insert);
+			m_tree.erase(zipfs_path);
+			m_tree.insert(zipfs_rename_path);
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	bool zipfs_index_t::insert(const zipfs_path_t& zipfs_path, zip_int64_t index) {
+		bool insert = map_insert(zipfs_path, index);
+		if (insert)
+			m_tree.insert(zipfs_path);
+		return insert;
+	}
+
+	bool zipfs_index_t::erase(const zipfs_path_t& zipfs_path) {
+		const zip_int64_t* find = map_find(zipfs_path);
+		if (find != nullptr) {
+			m_deleted.push_back(*find);
+			map_erase(zipfs_path);
+			m_tree.erase(zipfs_path);
 			return true;
 		}
 		else {
@@ -59,18 +120,52 @@ namespace zipfs {
 	}
 
 	void zipfs_index_t::clear() {
-		m_map.clear();
+		m_map->clear();
+		m_tree.clear();
+		m_deleted.clear();
+		m_is_init = false;
 	}
 
 	bool zipfs_index_t::empty() const {
-		return m_map.empty();
+		return m_map->empty();
 	}
 
 	zip_int64_t zipfs_index_t::index(const zipfs_path_t& zipfs_path) const {
-		auto find = m_map.find(zipfs_path);
-		if (find != m_map.end())
-			return find->second;
+		const zip_int64_t* find = map_find(zipfs_path);
+		if (find != nullptr)
+			return *find;
 		else
 			return -1;
 	}
+
+	void zipfs_index_t::ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) const {
+		m_tree.ls(zipfs_path, result, strict);
+	}
+
+#if ZIPFS_INDEX_T_HASH_MAP
+	const zip_int64_t* zipfs_index_t::map_find(const zipfs_path_t& zipfs_path) const {
+		return m_map->find(zipfs_path.string());
+	}
+
+	bool zipfs_index_t::map_insert(const zipfs_path_t& zipfs_path, zip_int64_t index) {
+		return m_map->insert(zipfs_path.string(), index);
+	}
+
+	bool zipfs_index_t::map_erase(const zipfs_path_t& zipfs_path) {
+		return m_map->erase(zipfs_path.string());
+	}
+#else
+	const zip_int64_t* zipfs_index_t::map_find(const zipfs_path_t& zipfs_path) const {
+		auto find = m_map->find(zipfs_path);
+		return find != m_map->end() ? &find->second : nullptr;
+	}
+
+	bool zipfs_index_t::map_insert(const zipfs_path_t& zipfs_path, zip_int64_t index) {
+		return m_map->insert({ zipfs_path, index }).second;
+	}
+
+	bool zipfs_index_t::map_erase(const zipfs_path_t& zipfs_path) {
+		return m_map->erase(zipfs_path) == 1;
+	}
+#endif
 }
\ No newline at end of file
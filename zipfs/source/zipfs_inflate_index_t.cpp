@@ -0,0 +1,244 @@
+#include <zipfs/zipfs_inflate_index_t.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+namespace zipfs {
+
+	namespace {
+
+		const zip_uint64_t
+			s_window_size = 32768,
+			s_chunk_size = 16384;
+
+		const char
+			s_magic[4] = { 'Z', 'F', 'I', '1' };
+
+		void put_64(std::vector<char>& data, zip_uint64_t value) {
+			for (int b = 0; b < 8; b++)
+				data.push_back(static_cast<char>((value >> (8 * b)) & 0xff));
+		}
+
+		bool get_64(const std::vector<char>& data, size_t& offset, zip_uint64_t& result) {
+			if (data.size() - offset < 8)
+				return false;
+
+			result = 0;
+			for (int b = 0; b < 8; b++)
+				result |= static_cast<zip_uint64_t>(static_cast<unsigned char>(data[offset + b])) << (8 * b);
+			offset += 8;
+			return true;
+		}
+
+		zip_int64_t read_input(zip_file_t* file, unsigned char* input) {
+			return zip_fread(file, input, s_chunk_size);
+		}
+	}
+
+	zipfs_inflate_index_t::zipfs_inflate_index_t() :
+		m_span{ 0 }, m_size{ 0 }, m_compressed_size{ 0 }, m_crc{ 0 } {}
+
+	bool zipfs_inflate_index_t::build(zip_file_t* file, zip_uint64_t span) {
+		m_checkpoints.clear();
+		m_span = span;
+
+		z_stream strm;
+		std::memset(&strm, 0, sizeof(strm));
+		if (inflateInit2(&strm, -15) != Z_OK)//.>raw deflate
+			return false;
+
+		checkpoint_t start;//.>raw deflate: inflate() doesn't stop before the first block
+		start.in = 0;
+		start.out = 0;
+		start.bits = 0;
+		m_checkpoints.push_back(std::move(start));
+
+		std::vector<unsigned char> input(s_chunk_size), window(s_window_size);
+		zip_uint64_t in = 0, out = 0, last = 0;
+		int ret = Z_OK;
+		strm.avail_out = 0;
+		do {
+			zip_int64_t read = read_input(file, input.data());
+			if (read <= 0) {//.>error or premature end
+				inflateEnd(&strm);
+				return false;
+			}
+			strm.avail_in = static_cast<uInt>(read);
+			strm.next_in = input.data();
+
+			do {
+				if (strm.avail_out == 0) {//.>window is full: wraps
+					strm.avail_out = static_cast<uInt>(s_window_size);
+					strm.next_out = window.data();
+				}
+
+				in += strm.avail_in;
+				out += strm.avail_out;
+				ret = inflate(&strm, Z_BLOCK);//.>returns at the end of each block
+				in -= strm.avail_in;
+				out -= strm.avail_out;
+				if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+					inflateEnd(&strm);
+					return false;
+				}
+				else if (ret == Z_STREAM_END)
+					break;
+
+				//.>at a block boundary, not after the last block
+				if ((strm.data_type & 128) && !(strm.data_type & 64) && out - last > span) {
+					checkpoint_t checkpoint;
+					checkpoint.in = in;
+					checkpoint.out = out;
+					checkpoint.bits = strm.data_type & 7;
+					{
+						zip_uint64_t left = strm.avail_out;
+						checkpoint.window.resize(s_window_size);
+						if (left != 0)
+							std::memcpy(checkpoint.window.data(), window.data() + s_window_size - left, left);
+						if (left < s_window_size)
+							std::memcpy(checkpoint.window.data() + left, window.data(), s_window_size - left);
+					}
+					m_checkpoints.push_back(std::move(checkpoint));
+					last = out;
+				}
+			} while (strm.avail_in != 0 || strm.avail_out == 0);//.>full window: the stream may end without more input
+		} while (ret != Z_STREAM_END);
+
+		inflateEnd(&strm);
+		return true;
+	}
+
+	bool zipfs_inflate_index_t::read(zip_file_t* file, zip_uint64_t offset, char* buf, zip_uint64_t len, zip_uint64_t& result) const {
+		result = 0;
+		if (m_checkpoints.empty())
+			return false;
+
+		//.>last checkpoint at or before offset
+		auto next = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), offset, [](zip_uint64_t offset, const checkpoint_t& checkpoint) { return offset < checkpoint.out; });
+		const checkpoint_t& checkpoint = *(next - 1);
+
+		if (zip_fseek(file, static_cast<zip_int64_t>(checkpoint.in - (checkpoint.bits != 0 ? 1 : 0)), SEEK_SET) != 0)
+			return false;
+
+		z_stream strm;
+		std::memset(&strm, 0, sizeof(strm));
+		if (inflateInit2(&strm, -15) != Z_OK)
+			return false;
+
+		std::vector<unsigned char> input(s_chunk_size), discard(s_window_size);
+		if (checkpoint.bits != 0) {
+			unsigned char c;
+			if (zip_fread(file, &c, 1) != 1) {
+				inflateEnd(&strm);
+				return false;
+			}
+			(void)inflatePrime(&strm, checkpoint.bits, c >> (8 - checkpoint.bits));
+		}
+		if (!checkpoint.window.empty())
+			(void)inflateSetDictionary(&strm, checkpoint.window.data(), static_cast<uInt>(s_window_size));
+
+		zip_uint64_t skip = offset - checkpoint.out;
+		while (result < len) {
+			if (strm.avail_in == 0) {
+				zip_int64_t read = read_input(file, input.data());
+				if (read <= 0) {
+					inflateEnd(&strm);
+					return false;
+				}
+				strm.avail_in = static_cast<uInt>(read);
+				strm.next_in = input.data();
+			}
+
+			if (skip != 0) {
+				strm.next_out = discard.data();
+				strm.avail_out = static_cast<uInt>(std::min(skip, s_window_size));
+			}
+			else {
+				strm.next_out = reinterpret_cast<unsigned char*>(buf + result);
+				strm.avail_out = static_cast<uInt>(std::min<zip_uint64_t>(len - result, 1 << 30));
+			}
+
+			uInt avail_out = strm.avail_out;
+			int ret = inflate(&strm, Z_NO_FLUSH);
+			if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+				inflateEnd(&strm);
+				return false;
+			}
+
+			zip_uint64_t produced = avail_out - strm.avail_out;
+			if (skip != 0)
+				skip -= produced;
+			else
+				result += produced;
+
+			if (ret == Z_STREAM_END)
+				break;
+		}
+
+		inflateEnd(&strm);
+		return true;
+	}
+
+	bool zipfs_inflate_index_t::matches(zip_uint64_t size, zip_uint64_t compressed_size, zip_uint32_t crc) const {
+		return !m_checkpoints.empty() && m_size == size && m_compressed_size == compressed_size && m_crc == crc;
+	}
+
+	void zipfs_inflate_index_t::set_entry(zip_uint64_t size, zip_uint64_t compressed_size, zip_uint32_t crc) {
+		m_size = size;
+		m_compressed_size = compressed_size;
+		m_crc = crc;
+	}
+
+	bool zipfs_inflate_index_t::empty() const {
+		return m_checkpoints.empty();
+	}
+
+	void zipfs_inflate_index_t::save(std::vector<char>& result) const {
+		result.assign(s_magic, s_magic + sizeof(s_magic));
+		put_64(result, m_span);
+		put_64(result, m_size);
+		put_64(result, m_compressed_size);
+		put_64(result, m_crc);
+		put_64(result, m_checkpoints.size());
+		for (const checkpoint_t& checkpoint : m_checkpoints) {
+			put_64(result, checkpoint.in);
+			put_64(result, checkpoint.out);
+			put_64(result, static_cast<zip_uint64_t>(checkpoint.bits));
+			put_64(result, checkpoint.window.size());
+			result.insert(result.end(), checkpoint.window.begin(), checkpoint.window.end());
+		}
+	}
+
+	bool zipfs_inflate_index_t::load(const std::vector<char>& data) {
+		zipfs_inflate_index_t index;
+		size_t offset = sizeof(s_magic);
+		zip_uint64_t crc, num_checkpoints;
+		if (data.size() < offset || !std::equal(s_magic, s_magic + sizeof(s_magic), data.begin()))
+			return false;
+		else if (!get_64(data, offset, index.m_span) || !get_64(data, offset, index.m_size) || !get_64(data, offset, index.m_compressed_size) || !get_64(data, offset, crc) || !get_64(data, offset, num_checkpoints))
+			return false;
+		index.m_crc = static_cast<zip_uint32_t>(crc);
+
+		for (zip_uint64_t c = 0; c < num_checkpoints; c++) {
+			checkpoint_t checkpoint;
+			zip_uint64_t bits, window_size;
+			if (!get_64(data, offset, checkpoint.in) || !get_64(data, offset, checkpoint.out) || !get_64(data, offset, bits) || !get_64(data, offset, window_size))
+				return false;
+			else if (bits > 7 || (window_size != 0 && window_size != s_window_size) || data.size() - offset < window_size)
+				return false;
+			else if (!index.m_checkpoints.empty() && checkpoint.out <= index.m_checkpoints.back().out)
+				return false;
+
+			checkpoint.bits = static_cast<int>(bits);
+			checkpoint.window.assign(data.begin() + offset, data.begin() + offset + window_size);
+			offset += window_size;
+			index.m_checkpoints.push_back(std::move(checkpoint));
+		}
+
+		if (offset != data.size() || index.m_checkpoints.empty() || index.m_checkpoints.front().out != 0)
+			return false;
+
+		*this = std::move(index);
+		return true;
+	}
+}
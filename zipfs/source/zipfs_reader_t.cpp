@@ -0,0 +1,131 @@
+#include <zipfs/zipfs_reader_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_error_strings.h>
+#include <algorithm>
+
+namespace zipfs {
+
+	zipfs_reader_t::zipfs_reader_t() :
+		m_zip_t{ nullptr }, m_zip_file_t{ nullptr }, m_size{ 0 }, m_offset{ 0 }, m_state{ nullptr }, m_data_offset{ 0 }, m_final{ false }, m_zipfs_path{ "/" }, m_open{ false } {}
+
+	zipfs_reader_t::~zipfs_reader_t() {
+		(void)close();
+	}
+
+	zipfs_error_t zipfs_reader_t::read(char* buffer, size_t byte_sz, size_t& result) {
+		zipfs_usage_assert(is_open(), ZIPFS_ERRSTR_READER_NOT_OPEN);
+
+		result = 0;
+		if (m_cipher.is_set())
+			return _zipfs_read_cipher(buffer, byte_sz, result);
+		else if (m_zip_file_t == nullptr) {//.>decrypted data
+			result = static_cast<size_t>(std::min<zip_uint64_t>(byte_sz, m_size - m_offset));
+			std::copy(m_data.begin() + m_offset, m_data.begin() + m_offset + result, buffer);
+			m_offset += result;
+			return zipfs_error_t::no_error();
+		}
+
+		while (result < byte_sz && m_offset < m_size) {//.>zip_fread() may return less than asked
+			zip_int64_t read = zip_fread(m_zip_file_t, buffer + result, byte_sz - result);
+			if (read == -1) {
+				zipfs_error_t ze = zip_file_get_error(m_zip_file_t);
+				ze.set_zipfs_path(m_zipfs_path);
+				return ze;
+			}
+			else if (read == 0) {
+				zipfs_error_t ze = ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL;
+				ze.set_zipfs_path(m_zipfs_path);
+				return ze;
+			}
+
+			result += static_cast<size_t>(read);
+			m_offset += static_cast<zip_uint64_t>(read);
+		}
+
+		return zipfs_error_t::no_error();
+	}
+
+	zipfs_error_t zipfs_reader_t::_zipfs_read_cipher(char* buffer, size_t byte_sz, size_t& result) {
+		while (result < byte_sz) {
+			if (m_data_offset < m_data.size()) {
+				size_t n = std::min(byte_sz - result, m_data.size() - m_data_offset);
+				std::copy(m_data.begin() + m_data_offset, m_data.begin() + m_data_offset + n, buffer + result);
+				m_data_offset += n;
+				m_offset += n;
+				result += n;
+				continue;
+			}
+			else if (m_final)
+				break;
+
+			m_in.resize(1 << 16);
+			zip_int64_t read = zip_fread(m_zip_file_t, m_in.data(), m_in.size());
+			if (read == -1) {
+				zipfs_error_t ze = zip_file_get_error(m_zip_file_t);
+				ze.set_zipfs_path(m_zipfs_path);
+				return ze;
+			}
+
+			m_data.clear();
+			m_data_offset = 0;
+			bool cipher;
+			if (read != 0)
+				cipher = m_cipher.update(m_state, reinterpret_cast<const uint8_t*>(m_in.data()), static_cast<size_t>(read), m_data);
+			else {
+				cipher = m_cipher.final(m_state, m_data);//.>releases the state
+				m_state = nullptr;
+				m_final = true;
+			}
+			if (!cipher) {
+				zipfs_error_t ze = ZIPFS_ERRSTR_CIPHER_ERROR;
+				ze.set_zipfs_path(m_zipfs_path);
+				return ze;
+			}
+		}
+
+		return zipfs_error_t::no_error();
+	}
+
+	zipfs_error_t zipfs_reader_t::close() {
+		zipfs_error_t ze = zipfs_error_t::no_error();
+
+		if (m_state != nullptr) {//.>closed before the end
+			std::vector<char> discard;
+			(void)m_cipher.final(m_state, discard);
+		}
+
+		if (m_zip_file_t != nullptr && zip_fclose(m_zip_file_t) != 0) {//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+			ze = ZIPFS_ERRSTR_FILE_CANNOT_CLOSE;
+			ze.set_zipfs_path(m_zipfs_path);
+		}
+		if (m_zip_t != nullptr)
+			zip_discard(m_zip_t);//.>read-only
+
+		m_zip_t = nullptr;
+		m_zip_file_t = nullptr;
+		m_data.clear();
+		m_data.shrink_to_fit();
+		m_in.clear();
+		m_in.shrink_to_fit();
+		m_size = 0;
+		m_offset = 0;
+		m_cipher = zipfs_cipher_t();
+		m_state = nullptr;
+		m_data_offset = 0;
+		m_final = false;
+		m_open = false;
+		return ze;
+	}
+
+	bool zipfs_reader_t::is_open() const {
+		return m_open;
+	}
+
+	zip_uint64_t zipfs_reader_t::size() const {
+		return m_size;
+	}
+
+	zip_uint64_t zipfs_reader_t::tell() const {
+		return m_offset;
+	}
+}
@@ -0,0 +1,32 @@
+#include <zipfs/zipfs_session_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_error_strings.h>
+
+namespace zipfs {
+
+	zipfs_session_t::zipfs_session_t(zipfs_t& zipfs, zipfs_error_t& ze) :
+		m_zipfs_t{ zipfs }, m_active{ false } {
+
+		ze = m_zipfs_t.session_begin();
+		m_active = !ze.is_error();
+	}
+
+	zipfs_session_t::~zipfs_session_t() {
+		if (m_active)
+			(void)discard();
+	}
+
+	zipfs_error_t zipfs_session_t::commit() {
+		zipfs_usage_assert(m_active, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+
+		m_active = false;
+		return m_zipfs_t.session_commit();
+	}
+
+	zipfs_error_t zipfs_session_t::discard() {
+		zipfs_usage_assert(m_active, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+
+		m_active = false;
+		return m_zipfs_t.session_discard();
+	}
+}
@@ -0,0 +1,188 @@
+#include <zipfs/zipfs_spill_file_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#endif
+
+namespace zipfs {
+
+	namespace {
+
+		zip_uint64_t map_alignment() {
+#ifdef _WIN32
+			SYSTEM_INFO system_info;
+			GetSystemInfo(&system_info);
+			return system_info.dwAllocationGranularity;
+#else
+			return static_cast<zip_uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+		}
+	}
+
+#ifdef _WIN32
+	zipfs_spill_file_t::zipfs_spill_file_t() :
+		m_handle{ INVALID_HANDLE_VALUE }, m_size{ 0 } {}
+
+	zipfs_spill_file_t::~zipfs_spill_file_t() {
+		if (m_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(m_handle);//.>FILE_FLAG_DELETE_ON_CLOSE
+	}
+
+	std::shared_ptr<zipfs_spill_file_t> zipfs_spill_file_t::create() {
+		std::error_code ec;
+		std::filesystem::path temp_directory = std::filesystem::temp_directory_path(ec);
+		if (ec)
+			return nullptr;
+
+		wchar_t temp_path[MAX_PATH];
+		if (GetTempFileNameW(temp_directory.c_str(), L"zfs", 0, temp_path) == 0)
+			return nullptr;
+
+		std::shared_ptr<zipfs_spill_file_t> spill_file{ new zipfs_spill_file_t() };
+		spill_file->m_handle = CreateFileW(temp_path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (spill_file->m_handle == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		DWORD returned;
+		(void)DeviceIoControl(spill_file->m_handle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);//.>released regions are zeroed without blocks; not sparse: released regions keep their blocks
+
+		return spill_file;
+	}
+
+	bool zipfs_spill_file_t::write(zip_uint64_t offset, const char* data, zip_uint64_t byte_sz) {
+		while (byte_sz != 0) {
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD written;
+			if (!WriteFile(m_handle, data, static_cast<DWORD>(std::min<zip_uint64_t>(byte_sz, 1 << 30)), &written, &overlapped))
+				return false;
+
+			offset += written;
+			data += written;
+			byte_sz -= written;
+		}
+		m_size = std::max(m_size, offset);
+		return true;
+	}
+
+	bool zipfs_spill_file_t::map(zip_uint64_t offset, zip_uint64_t byte_sz, zipfs_buffer_t::segment_t& result) {
+		zipfs_internal_assert(offset % map_alignment() == 0);
+		zipfs_internal_assert(offset + byte_sz <= m_size);
+
+		HANDLE mapping = CreateFileMappingW(m_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+			return false;
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), static_cast<SIZE_T>(byte_sz));
+		CloseHandle(mapping);
+		if (data == nullptr)
+			return false;
+
+		std::shared_ptr<zipfs_spill_file_t> spill_file = shared_from_this();
+		result.data = std::shared_ptr<const char>{ static_cast<const char*>(data), [spill_file, offset, byte_sz](const char* p) {
+			UnmapViewOfFile(p);
+			spill_file->release(offset, byte_sz);
+		} };
+		result.size = byte_sz;
+		result.heap = false;
+		return true;
+	}
+
+	void zipfs_spill_file_t::release(zip_uint64_t offset, zip_uint64_t byte_sz) {
+		FILE_ZERO_DATA_INFORMATION zero_data;
+		zero_data.FileOffset.QuadPart = static_cast<LONGLONG>(offset);
+		zero_data.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(offset + byte_sz);
+		DWORD returned;
+		(void)DeviceIoControl(m_handle, FSCTL_SET_ZERO_DATA, &zero_data, sizeof(zero_data), nullptr, 0, &returned, nullptr);
+	}
+#else
+	zipfs_spill_file_t::zipfs_spill_file_t() :
+		m_fd{ -1 }, m_size{ 0 } {}
+
+	zipfs_spill_file_t::~zipfs_spill_file_t() {
+		if (m_fd != -1)
+			close(m_fd);//.>unlinked on creation
+	}
+
+	std::shared_ptr<zipfs_spill_file_t> zipfs_spill_file_t::create() {
+		std::error_code ec;
+		std::filesystem::path temp_directory = std::filesystem::temp_directory_path(ec);
+		if (ec)
+			return nullptr;
+
+		std::shared_ptr<zipfs_spill_file_t> spill_file{ new zipfs_spill_file_t() };
+#ifdef O_TMPFILE
+		spill_file->m_fd = open(temp_directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+		if (spill_file->m_fd == -1) {//.>no O_TMPFILE: create and unlink
+			std::string temp_path = (temp_directory / "zipfs-XXXXXX").string();
+			spill_file->m_fd = mkstemp(temp_path.data());
+			if (spill_file->m_fd == -1)
+				return nullptr;
+			(void)unlink(temp_path.c_str());
+		}
+
+		return spill_file;
+	}
+
+	bool zipfs_spill_file_t::write(zip_uint64_t offset, const char* data, zip_uint64_t byte_sz) {
+		while (byte_sz != 0) {
+			ssize_t written = pwrite(m_fd, data, static_cast<size_t>(byte_sz), static_cast<off_t>(offset));
+			if (written == -1 && errno == EINTR)
+				continue;
+			else if (written <= 0)
+				return false;
+
+			offset += written;
+			data += written;
+			byte_sz -= written;
+		}
+		m_size = std::max(m_size, offset);
+		return true;
+	}
+
+	bool zipfs_spill_file_t::map(zip_uint64_t offset, zip_uint64_t byte_sz, zipfs_buffer_t::segment_t& result) {
+		zipfs_internal_assert(offset % map_alignment() == 0);
+		zipfs_internal_assert(offset + byte_sz <= m_size);
+
+		void* data = mmap(nullptr, static_cast<size_t>(byte_sz), PROT_READ, MAP_SHARED, m_fd, static_cast<off_t>(offset));
+		if (data == MAP_FAILED)
+			return false;
+
+		std::shared_ptr<zipfs_spill_file_t> spill_file = shared_from_this();
+		result.data = std::shared_ptr<const char>{ static_cast<const char*>(data), [spill_file, offset, byte_sz](const char* p) {
+			munmap(const_cast<char*>(p), static_cast<size_t>(byte_sz));
+			spill_file->release(offset, byte_sz);
+		} };
+		result.size = byte_sz;
+		result.heap = false;
+		return true;
+	}
+
+	void zipfs_spill_file_t::release(zip_uint64_t offset, zip_uint64_t byte_sz) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+		(void)fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(byte_sz));//.>not supported by the file system: the blocks are kept
+#else
+		(void)offset;
+		(void)byte_sz;
+#endif
+	}
+#endif
+
+	zip_uint64_t zipfs_spill_file_t::region() {
+		zip_uint64_t alignment = map_alignment();
+		m_size = (m_size + alignment - 1) / alignment * alignment;
+		return m_size;
+	}
+}
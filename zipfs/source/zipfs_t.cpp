@@ -1,17 +1,21 @@
 #include <zipfs/zipfs_t.h>
 #include <zipfs/zipfs_assert.h>
 #include <zipfs/zipfs_error_strings.h>
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <zipfs/zipfs_cdir_t.h>
+#include <zipfs/zipfs_cipher_source_t.h>
+#include <zipfs/zipfs_inflate_index_t.h>
+#include <zipfs/zipfs_spill_file_t.h>
+#include <algorithm>
 #if ZIPFS_ZIP_SOURCE_T_EXTRA_CHECKS
 #include <zipint.h>//.>zip_source_t
 #endif
 
 namespace zipfs {
 
-	zipfs_t::zipfs_t(zipfs_error_t& ze) :
-		m_compression{ ZIP_CM_DEFLATE }, m_compression_flags{ 0 }, m_zip_source_t{ nullptr }, m_zip_t{ nullptr }, m_zip_source_t_buffer{ nullptr }, m_ze{ zipfs_error_t::no_error() },
-		m_file_encrypt_func{ nullptr }, m_file_decrypt_func{ nullptr }, m_file_encrypt{ false }, m_file_decrypt{ false } {
+	zipfs_t::zipfs_t(zipfs_error_t& ze) {
 
-		if (!_zipfs_source_new(nullptr, 0)) {
+		if (!_zipfs_source_new(zipfs_buffer_t())) {
 			ze = m_ze;
 			return;
 		}
@@ -25,16 +29,42 @@ namespace zipfs {
 		ze = m_ze;
 	}
 
-	zipfs_t::zipfs_t(char* buffer, size_t byte_sz, zipfs_error_t& ze) :
-		m_compression{ ZIP_CM_DEFLATE }, m_compression_flags{ 0 }, m_zip_source_t{ nullptr }, m_zip_t{ nullptr }, m_zip_source_t_buffer{ nullptr }, m_ze{ zipfs_error_t::no_error() },
-		m_file_encrypt_func{ nullptr }, m_file_decrypt_func{ nullptr }, m_file_encrypt{ false }, m_file_decrypt{ false } {
+	zipfs_t::zipfs_t(char* buffer, size_t byte_sz, zipfs_error_t& ze) {
 
-		if (!_zipfs_source_new(buffer, byte_sz)) {
-			ze = m_ze;
+		_zipfs_source_init(zipfs_buffer_t(buffer, byte_sz), ze);//acquire buffer (copy)
+	}
+
+	zipfs_t::zipfs_t(std::vector<char>&& buffer, zipfs_error_t& ze) {
+
+		_zipfs_source_init(zipfs_buffer_t(std::move(buffer)), ze);//adopt buffer
+	}
+
+	zipfs_t::zipfs_t(std::shared_ptr<const std::byte[]> buffer, size_t byte_sz, zipfs_error_t& ze) {
+
+		std::shared_ptr<const char> buffer_{ buffer, reinterpret_cast<const char*>(buffer.get()) };//.>aliasing: shares buffer's ownership
+		_zipfs_source_init(zipfs_buffer_t(std::move(buffer_), byte_sz), ze);
+	}
+
+	zipfs_t::zipfs_t(const filesystem_path_t& fs_path, zipfs_error_t& ze) :
+		zipfs_t(fs_path, OPEN_MODE::FILE_BACKED, ze) {}
+
+	zipfs_t::zipfs_t(const filesystem_path_t& fs_path, OPEN_MODE open_mode, zipfs_error_t& ze) {
+
+		if (open_mode == OPEN_MODE::MAPPED) {
+			zipfs_buffer_t buffer;
+			if (!zipfs_buffer_t::map(fs_path, buffer)) {
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_MAP_FILE, "/", fs_path);
+				ze = m_ze;
+				return;
+			}
+
+			m_open_flags = ZIPFS_ZIP_FLAGS_NONE;
+			_zipfs_source_init(buffer, ze);
 			return;
 		}
 
-		if (!zipfs_image_update() || !_zipfs_image_internal_update()) {
+		m_fs_path = fs_path;
+		if (!_zipfs_source_new_file()) {
 			ze = m_ze;
 			return;
 		}
@@ -49,37 +79,62 @@ namespace zipfs {
 	}
 
 	zipfs_t::~zipfs_t() {
+		if (m_session)
+			session_discard();
 		_zipfs_source_free();
 	}
 
-	bool zipfs_t::_zipfs_source_new(char* buffer, size_t byte_sz) {
+	bool zipfs_t::_zipfs_source_new(const zipfs_buffer_t& buffer) {
 		zipfs_internal_assert(m_zip_t == nullptr);
 		zipfs_internal_assert(m_zip_source_t == nullptr);
-		zipfs_internal_assert(m_zip_source_t_buffer == nullptr);
-
-		// zip_source_buffer_create https://libzip.org/documentation/zip_source_buffer_create.html
-		// If freep is non-zero, the buffer will be freed when it is no longer needed,
-		// data must remain valid for the lifetime of the created source.
-
-		if (buffer != nullptr && byte_sz != 0) {
-			m_zip_source_t_buffer = new char[byte_sz];//acquire buffer (copy)
-			char* it = std::copy(buffer, buffer + byte_sz, m_zip_source_t_buffer);
-			zipfs_internal_assert(it == m_zip_source_t_buffer + byte_sz);
-			zip_source_t* zs = zip_source_buffer_create(m_zip_source_t_buffer, byte_sz, s_zip_source_t_buffer_auto_free ? 1 : 0, &m_ze.m_zip_error);
-			if (zs == nullptr)
-				return false;
+		zipfs_internal_assert(m_zipfs_buffer_source_t == nullptr);
 
-			m_zip_source_t = zs;
-			return true;
+		//.>the source shares buffer's segments; zip_close() writes the changed tail of the archive to a new segment
+		zip_source_t* zs = zipfs_buffer_source_t::create(buffer, &m_zipfs_buffer_source_t, &m_ze.m_zip_error);
+		if (zs == nullptr)
+			return false;
+
+		m_zipfs_buffer_source_t->set_memory_budget(m_memory_budget);
+		m_zip_source_t = zs;
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_source_new_file() {
+		zipfs_internal_assert(m_zip_t == nullptr);
+		zipfs_internal_assert(m_zip_source_t == nullptr);
+		zipfs_internal_assert(_zipfs_file_backed());
+
+		//.>libzip writes to a temporary file renamed over fs_path on commit
+		zip_source_t* zs = zip_source_file_create(m_fs_path.u8path().c_str(), 0, -1, &m_ze.m_zip_error);
+		if (zs == nullptr)
+			return false;
+
+		m_zip_source_t = zs;
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_file_backed() const {
+		return !m_fs_path.platform_path().empty();
+	}
+
+	void zipfs_t::_zipfs_source_init(const zipfs_buffer_t& buffer, zipfs_error_t& ze) {
+		if (!_zipfs_source_new(buffer)) {
+			ze = m_ze;
+			return;
 		}
-		else {
-			zip_source_t* zs = zip_source_buffer_create(nullptr, 0, s_zip_source_t_buffer_auto_free ? 1 : 0, &m_ze.m_zip_error);
-			if (zs == nullptr)
-				return false;
 
-			m_zip_source_t = zs;
-			return true;
+		if (!zipfs_image_update()) {
+			ze = m_ze;
+			return;
 		}
+
+		//.>do we have a valid archive? test open/close
+		if (!_zipfs_open(ZIPFS_ZIP_FLAGS_NONE)) {
+			ze = m_ze;
+			return;
+		}
+		_zipfs_no_error_and_close();
+		ze = m_ze;
 	}
 
 	void zipfs_t::_zipfs_source_free()  {
@@ -89,17 +144,9 @@ namespace zipfs {
 		zipfs_internal_assert(m_zip_source_t->src == nullptr);
 		zipfs_internal_assert(m_zip_source_t->refcount == 1);
 #endif
-		//si on utilise freep = 0, il faut supprimer le buffer avec delete[] => (mais bugg si archive cre avec WinRar)
-		//si on utilise freep = 1, il faut supprimer le buffer avec zip_source_free() [avec refcount=0]
-#if ZIPFS_ZIP_SOURCE_T_BUFFER_AUTO_FREE == 1
-		(void)zip_source_free(m_zip_source_t);//ref--
-#else
-		(void)zip_source_free(m_zip_source_t);//ref-- //<-DO NOT CREATE THE ARCHIVE WITH WINRAR!! //&!zip_rename??
-		if (m_zip_source_t_initial_buffer != nullptr)
-			delete[] m_zip_source_t_initial_buffer;
-#endif
+		(void)zip_source_free(m_zip_source_t);//ref-- (frees m_zipfs_buffer_source_t)
 		m_zip_source_t = nullptr;
-		m_zip_source_t_buffer = nullptr;
+		m_zipfs_buffer_source_t = nullptr;
 	}
 
 	void zipfs_t::_zipfs_error_init() {
@@ -107,47 +154,56 @@ namespace zipfs {
 	}
 
 	bool zipfs_t::_zipfs_open(int open_flags) {
+		if (m_session) {//archive is already open
+			zipfs_internal_assert(m_zip_t != nullptr);
+			_zipfs_error_init();//init error
+			return true;
+		}
+
 		zipfs_internal_assert(m_zip_t == nullptr);
 
+		if (_zipfs_file_backed())//.>the file may not exist (yet, or anymore)
+			open_flags |= ZIP_CREATE;
+
 		_zipfs_error_init();//init error
-		m_zip_t = zip_open_from_source(m_zip_source_t, ZIP_CHECKCONS | open_flags, &m_ze.m_zip_error);
+		m_zip_t = zip_open_from_source(m_zip_source_t, m_open_flags | open_flags, &m_ze.m_zip_error);
 
 		if (m_zip_t == nullptr && m_ze.m_zip_error.zip_err == ZIP_ER_DELETED) {//archive was emptied and is not valid anymore, recreate source
 			_zipfs_error_init();//init error
 			_zipfs_source_free();
-			_zipfs_source_new(nullptr, 0);
-			m_zip_t = zip_open_from_source(m_zip_source_t, ZIP_CHECKCONS | open_flags, &m_ze.m_zip_error);
+			if (_zipfs_file_backed())
+				_zipfs_source_new_file();
+			else
+				_zipfs_source_new(zipfs_buffer_t());
+			m_zipfs_index_t.clear();
+			m_zip_t = zip_open_from_source(m_zip_source_t, m_open_flags | open_flags, &m_ze.m_zip_error);
 		}
 
 		if (m_zip_t != nullptr) {
-			if (m_zipfs_index_t.empty()) {//build index if it's empty
+			if (!m_zipfs_index_t.is_init()) {//build index only if the source was replaced
 				m_zipfs_index_t.init(m_zip_t);
+			}
 #ifdef _DEBUG
-				zipfs_internal_assert(m_zipfs_index_t.verify(m_zip_t));
+			zipfs_internal_assert(m_zipfs_index_t.verify(m_zip_t));
 #endif
-			}
 		}
 
 		return !m_ze.is_error();
 	}
 
-	void zipfs_t::_zipfs_close() {
+	bool zipfs_t::_zipfs_close() {
 		zipfs_internal_assert(m_zip_t != nullptr);
 
-		(void)zip_source_keep(m_zip_source_t);//ref++
-		if (zip_close(m_zip_t) == -1) {
-			zipfs_internal_assert(false);//couldn't close, debug it
-		}
-
-		m_zip_t = nullptr;
+		if (m_session)//archive is written on session_commit()
+			return true;
 
-#if 0
-		if ((open_flags & ZIP_RDONLY) == 0) {//invalidate index only if !ZIP_RDONLY operation?
-			m_zipfs_index_t.clear();
+		zipfs_error_t ze = m_ze;
+		if (!_zipfs_commit()) {//.>pending changes are lost, as with session_commit()
+			if (ze.is_error())
+				m_ze = ze;
+			return false;
 		}
-#else
-		m_zipfs_index_t.clear();
-#endif
+		return true;
 	}
 
 	void zipfs_t::_zipfs_unchange_all() {
@@ -156,11 +212,16 @@ namespace zipfs {
 		if (zip_unchange_all(m_zip_t) == -1) {
 			zipfs_internal_assert(false);//couldn't unchange, debug it
 		}
+
+		//.>entries added or deleted since open are reverted, rebuild the index
+		m_zipfs_index_t.clear();
+		m_zipfs_index_t.init(m_zip_t);
+		_zipfs_pending_clear();
 	}
 
-	void zipfs_t::_zipfs_no_error_and_close() {
+	bool zipfs_t::_zipfs_no_error_and_close() {
 		zipfs_internal_assert(!m_ze.is_error());
-		_zipfs_close();
+		return _zipfs_close();
 	}
 
 	void zipfs_t::_zipfs_zip_get_error(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path) {
@@ -221,9 +282,14 @@ namespace zipfs {
 			(void)zip_source_free(src);
 			return false;
 		}
+		else if (!m_zipfs_index_t.insert(zipfs_path, index)) {
+			zipfs_internal_assert(false);
+		}
+		_zipfs_pending_change(zipfs_path);
+		_zipfs_pending_source(index, src);
 
 		if (zip_set_file_compression(m_zip_t, index, m_compression, m_compression_flags) == -1) {
-			_zipfs_unchange_all();//.>zip_file_add revert
+			_zipfs_entry_add_revert(zipfs_path, index);//.>zip_file_add revert
 			//zip_source_free();//.>not here: https://libzip.org/documentation/zip_source_free.html
 			return false;
 		}
@@ -231,35 +297,51 @@ namespace zipfs {
 		return true;
 	}
 
-	bool zipfs_t::_zipfs_file_add_replace_or_pull_replace_from_source(zip_int64_t index, zip_source_t* src) {
+	bool zipfs_t::_zipfs_file_add_replace_or_pull_replace_from_source(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_source_t* src) {
 		zipfs_internal_assert(m_zip_t != nullptr);
 
-		if (zip_file_replace(m_zip_t, index, src, ZIPFS_ZIP_FL_ENC) == -1) {
+		if (zip_set_file_compression(m_zip_t, index, m_compression, m_compression_flags) == -1) {//.>before zip_file_replace: the replaced data can't be restored
 			(void)zip_source_free(src);
 			return false;
 		}
-
-		if (zip_set_file_compression(m_zip_t, index, m_compression, m_compression_flags) == -1) {
-			_zipfs_unchange_all();//.>zip_file_replace revert
-			//zip_source_free();//.>not here: https://libzip.org/documentation/zip_source_free.html
+		else if (zip_file_replace(m_zip_t, index, src, ZIPFS_ZIP_FL_ENC) == -1) {
+			(void)zip_source_free(src);
 			return false;
 		}
+		_zipfs_pending_change(zipfs_path);
+		_zipfs_pending_source(index, src);
 
 		return true;
 	}
 
-	bool zipfs_t::_zipfs_source_buffer_encrypt(const zipfs_path_t& zipfs_path, const std::vector<char>& buffer, zip_source_t** src) {
+	bool zipfs_t::_zipfs_source_buffer_encrypt(const zipfs_path_t& zipfs_path, const char* buffer, size_t byte_sz, zip_source_t** src) {
 		uint8_t* ret_buf = nullptr;
 		size_t ret_len;
 		{
-			m_file_encrypt_func(zipfs_path.c_str(), reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), &ret_buf, &ret_len);
+			m_file_encrypt_func(zipfs_path.c_str(), reinterpret_cast<const uint8_t*>(buffer), byte_sz, &ret_buf, &ret_len);
 			*src = zip_source_buffer(m_zip_t, ret_buf, ret_len, 1);//auto-free ici (on a besoin de ret_buf* plus tard)
 		}
 		return *src != nullptr;
 	}
 
+	bool zipfs_t::_zipfs_encrypt_func() const {
+		return m_file_encrypt && !m_file_encrypt_cipher.is_set() && m_file_encrypt_func != nullptr;
+	}
+
+	bool zipfs_t::_zipfs_encrypt_cipher() const {
+		return m_file_encrypt && m_file_encrypt_cipher.is_set();
+	}
+
+	bool zipfs_t::_zipfs_decrypt_func() const {
+		return m_file_decrypt && !m_file_decrypt_cipher.is_set() && m_file_decrypt_func != nullptr;
+	}
+
+	bool zipfs_t::_zipfs_decrypt_cipher() const {
+		return m_file_decrypt && m_file_decrypt_cipher.is_set();
+	}
+
 	bool zipfs_t::_zipfs_set_dir_mtime(const zipfs_path_t& zipfs_path, time_t mtime) {
-		zipfs_internal_assert(m_zip_t == nullptr);
+		zipfs_internal_assert(m_zip_t == nullptr || m_session);
 		zipfs_internal_assert(zipfs_path.is_dir());
 
 		if (!
@@ -276,40 +358,69 @@ namespace zipfs {
 			_zipfs_zip_get_error_and_close(zipfs_path, "");
 			return false;
 		}
+		_zipfs_pending_change(zipfs_path);
 
-		_zipfs_no_error_and_close();
-		return true;
+		return _zipfs_no_error_and_close();
 	}
 
-	bool zipfs_t::_zipfs_revert_to_image_internal() {
-		zipfs_internal_assert(m_zip_t == nullptr);
+	void zipfs_t::_zipfs_pending_change(const zipfs_path_t& zipfs_path) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+		m_pending_changes.push_back(zipfs_path);
+	}
 
-		_zipfs_source_free();
-		if (!
-			_zipfs_source_new(m_zip_source_t_image_internal.data(), m_zip_source_t_image_internal.size()))
-			return false;
+	void zipfs_t::_zipfs_pending_source(zip_int64_t index, zip_source_t* src) {
+		zipfs_internal_assert(m_zip_t != nullptr);
 
-		m_zipfs_index_t = m_zipfs_index_t_image_internal;
+		(void)zip_source_keep(src);//ref++
+		auto insert = m_pending_sources.insert({ index, pending_source_t{ src, m_compression, m_compression_flags } });
+		if (!insert.second) {//.>entry replaced again
+			(void)zip_source_free(insert.first->second.src);//ref--
+			insert.first->second = pending_source_t{ src, m_compression, m_compression_flags };
+		}
+	}
 
-		return true;
+	void zipfs_t::_zipfs_pending_revert(const zipfs_path_t& zipfs_path) {
+		auto change = std::find(m_pending_changes.rbegin(), m_pending_changes.rend(), zipfs_path);
+		zipfs_internal_assert(change != m_pending_changes.rend());
+		m_pending_changes.erase(std::next(change).base());
 	}
 
-	bool zipfs_t::_zipfs_image_internal_update() {
-		zipfs_internal_assert(m_zip_t == nullptr);
+	void zipfs_t::_zipfs_entry_add_revert(const zipfs_path_t& zipfs_path, zip_int64_t index) {
+		zipfs_internal_assert(m_zip_t != nullptr);
 
-		std::vector<char> buf;
-		if (!
-			get_source(buf))
-			return false;
+		if (zip_delete(m_zip_t, index) == -1) {//.>an entry added since open is dropped, not written
+			zipfs_internal_assert(false);
+		}
+		else if (!m_zipfs_index_t.erase(zipfs_path)) {
+			zipfs_internal_assert(false);
+		}
+		_zipfs_pending_revert(zipfs_path);
 
-		m_zip_source_t_image_internal.clear();
-		m_zip_source_t_image_internal.assign(buf.data(), buf.data() + buf.size());
-		m_zipfs_index_t_image_internal = m_zipfs_index_t;
+		auto pending_source = m_pending_sources.find(index);
+		if (pending_source != m_pending_sources.end()) {
+			(void)zip_source_free(pending_source->second.src);//ref--
+			m_pending_sources.erase(pending_source);
+		}
+	}
 
-		return true;
+	void zipfs_t::_zipfs_pending_changes_written() {
+		if (!m_pending_changes.empty()) {//.>else zip_close() didn't write anything
+			m_generation++;
+			m_image_modifications.insert(m_pending_changes.begin(), m_pending_changes.end());
+			for (const zipfs_path_t& zipfs_path : m_pending_changes)
+				m_inflate_indexes.erase(zipfs_path);
+		}
+		_zipfs_pending_clear();
 	}
 
-	bool zipfs_t::_zipfs_file_add(const zipfs_path_t& zipfs_path, const std::vector<char>& buffer, QUERY_RESULT qr) {
+	void zipfs_t::_zipfs_pending_clear() {
+		m_pending_changes.clear();
+		for (auto& pending_source : m_pending_sources)
+			(void)zip_source_free(pending_source.second.src);//ref--
+		m_pending_sources.clear();
+	}
+
+	bool zipfs_t::_zipfs_file_add(const zipfs_path_t& zipfs_path, const char* buffer, size_t byte_sz, const zipfs_buffer_t* stream, QUERY_RESULT qr) {
 		switch (qr) {
 		case QUERY_RESULT::FILE_WRITE:
 		case QUERY_RESULT::FILE_OVERWRITE: {
@@ -320,17 +431,38 @@ namespace zipfs {
 			zip_int64_t index_ = _zipfs_name_locate(zipfs_path);
 
 			zip_source_t* src;
-			bool buffer_encrypt = m_file_encrypt && m_file_encrypt_func != nullptr;
+			bool buffer_encrypt = _zipfs_encrypt_func();
+
+			zipfs_buffer_t session_copy;
+			if (stream == nullptr && !buffer_encrypt && m_session && byte_sz != 0) {//buffer must outlive this call; acquire a copy, read on commit as writer data
+				session_copy = zipfs_buffer_t(buffer, byte_sz);
+				stream = &session_copy;
+			}
 
-			if (buffer_encrypt) {
-				_zipfs_source_buffer_encrypt(zipfs_path, buffer, &src);
+			if (stream != nullptr) {//.>zipfs_writer_t data, or the session copy, read on commit
+				zip_error_t ze;
+				zip_error_init(&ze);
+				zipfs_buffer_source_t* stream_buffer;
+				src = zipfs_buffer_source_t::create(*stream, &stream_buffer, &ze);
+				if (src == nullptr) {
+					m_ze = &ze;
+					zip_error_fini(&ze);
+					_zipfs_close();
+					return false;
+				}
+				zip_error_fini(&ze);
+			}
+			else if (buffer_encrypt) {
+				_zipfs_source_buffer_encrypt(zipfs_path, buffer, byte_sz, &src);
 			}
 			else {
-				src = zip_source_buffer(m_zip_t, buffer.data(), buffer.size(), 0);//0 = don't auto free the std::vector<char>& buffer
+				src = zip_source_buffer(m_zip_t, buffer, byte_sz, 0);//0 = don't auto free the caller's buffer
 			}
 
+			if (src != nullptr && _zipfs_encrypt_cipher())//.>encrypted as libzip reads it
+				src = zipfs_cipher_source_t::create(src, m_file_encrypt_cipher, zipfs_path.c_str(), &m_cipher_failed, zip_get_error(m_zip_t));
+
 			if (src == nullptr) {
-				_zipfs_unchange_all();
 				_zipfs_zip_get_error_and_close("/", "");//.>buffer error
 				return false;
 			}
@@ -342,17 +474,17 @@ namespace zipfs {
 				break;
 			}
 			case QUERY_RESULT::FILE_OVERWRITE: {
-				from_source = _zipfs_file_add_replace_or_pull_replace_from_source(index_, src);
+				from_source = _zipfs_file_add_replace_or_pull_replace_from_source(zipfs_path, index_, src);
 				break;
 			}
 			}
-			if (!from_source) {
-				_zipfs_unchange_all();
+			if (!from_source) {//.>reverted
 				_zipfs_zip_get_error_and_close(zipfs_path, "");
 				return false;
 			}
 
-			_zipfs_no_error_and_close();
+			if (!_zipfs_no_error_and_close())
+				return false;
 			break;
 		}
 		case QUERY_RESULT::FILE_DONT_OVERWRITE:
@@ -372,7 +504,7 @@ namespace zipfs {
 		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
 
 		QUERY_RESULT qr = _zipfs_get_query_result(overwrite, zipfs_path);
-		_zipfs_file_add(zipfs_path, buffer, qr);
+		_zipfs_file_add(zipfs_path, buffer.data(), buffer.size(), nullptr, qr);
 		return m_ze;
 	}
 
@@ -380,7 +512,53 @@ namespace zipfs {
 		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
 
 		QUERY_RESULT qr = _zipfs_get_query_result(overwrite, zipfs_path);
-		_zipfs_file_add(zipfs_path, std::vector<char>{ buffer.begin(), buffer.end() }, qr);
+		_zipfs_file_add(zipfs_path, buffer.data(), buffer.size(), nullptr, qr);//.>no copy
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::open_writer(const zipfs_path_t& zipfs_path, zipfs_writer_t& result, OVERWRITE overwrite) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		_zipfs_error_init();
+		result.discard();
+
+		std::shared_ptr<zipfs_spill_file_t> spill_file = zipfs_spill_file_t::create();
+		if (spill_file == nullptr) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE, zipfs_path, "");
+			return m_ze;
+		}
+
+		result.m_zipfs_t = this;
+		result.m_zipfs_path = zipfs_path;
+		result.m_overwrite = overwrite;
+		result.m_offset = spill_file->region();
+		result.m_spill_file = spill_file;
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::_zipfs_writer_finish(zipfs_writer_t& writer) {
+		_zipfs_error_init();
+
+		//.>the written data, mapped: read on commit
+		zipfs_buffer_t stream;
+		if (writer.m_size != 0) {
+			zipfs_buffer_t::segment_t segment;
+			if (!writer.m_spill_file->map(writer.m_offset, writer.m_size, segment)) {
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_MAP_FILE, writer.m_zipfs_path, "");
+				return m_ze;
+			}
+			stream.append(segment);
+		}
+
+		QUERY_RESULT qr = _zipfs_get_query_result(writer.m_overwrite, writer.m_zipfs_path);
+		if (_zipfs_encrypt_func()) {//.>the encrypt function takes the whole file
+			std::vector<char> buffer;
+			stream.copy_to(buffer);
+			_zipfs_file_add(writer.m_zipfs_path, buffer.data(), buffer.size(), nullptr, qr);
+		}
+		else {
+			_zipfs_file_add(writer.m_zipfs_path, nullptr, 0, &stream, qr);
+		}
 		return m_ze;
 	}
 
@@ -401,6 +579,10 @@ namespace zipfs {
 			_zipfs_zip_get_error_and_close(zipfs_path, "");
 			return m_ze;
 		}
+		else if (!m_zipfs_index_t.erase(zipfs_path)) {
+			zipfs_internal_assert(false);
+		}
+		_zipfs_pending_change(zipfs_path);
 
 		_zipfs_no_error_and_close();
 		return m_ze;
@@ -419,7 +601,6 @@ namespace zipfs {
 
 		zip_int64_t index = _zipfs_name_locate(zipfs_path);
 		if (index == -1) {
-			_zipfs_unchange_all();//.>mkdir revert
 			_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, zipfs_path, "");
 			return m_ze;
 		}
@@ -432,6 +613,8 @@ namespace zipfs {
 		else if (!m_zipfs_index_t.rename(zipfs_path, zipfs_rename_path)) {
 			zipfs_internal_assert(false);
 		}
+		_zipfs_pending_change(zipfs_path);
+		_zipfs_pending_change(zipfs_rename_path);
 
 		_zipfs_no_error_and_close();
 		return m_ze;
@@ -445,6 +628,7 @@ namespace zipfs {
 			return m_ze;
 
 		std::vector<std::string> tree = zipfs_path.tree();
+		std::vector<std::pair<zipfs_path_t, zip_int64_t>> added;
 		zipfs_path_t dir = "/";
 		for (size_t d = 0; d < tree.size(); d++) {
 			dir += (tree[d] + "/");
@@ -452,10 +636,17 @@ namespace zipfs {
 			zip_int64_t index = _zipfs_name_locate(dir);
 			if (index == -1) {
 				if ((index = zip_dir_add(m_zip_t, dir.libzip_path_dir_add().c_str(), ZIPFS_ZIP_FL_ENC)) == -1) {//zip_dir_add doesn't expect trailing '/'
-					_zipfs_unchange_all();
-					_zipfs_zip_get_error_and_close(dir, "");
+					_zipfs_zip_get_error(dir, "");
+					for (auto a = added.rbegin(); a != added.rend(); ++a)//.>mkdir revert
+						_zipfs_entry_add_revert(a->first, a->second);
+					_zipfs_close();
 					return m_ze;
 				}
+				else if (!m_zipfs_index_t.insert(dir, index)) {
+					zipfs_internal_assert(false);
+				}
+				_zipfs_pending_change(dir);
+				added.push_back({ dir, index });
 			}
 			else {
 				//dir exists; not an error
@@ -479,20 +670,27 @@ namespace zipfs {
 			return m_ze;
 
 		delete_count = 0;
+		std::vector<zip_int64_t> indexes;//.>located first: a missing entry fails the operation before anything is deleted
 		for (const zipfs_path_t& p : ls_) {
 			zip_int64_t index = _zipfs_name_locate(p);
 			if (index == -1) {
-				_zipfs_unchange_all();
-				delete_count = 0;
 				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, p, "");
 				return m_ze;
 			}
-			else if (zip_delete(m_zip_t, index) == -1) {
-				_zipfs_unchange_all();
-				delete_count = 0;
+			indexes.push_back(index);
+		}
+
+		for (size_t i = 0; i < ls_.size(); i++) {
+			const zipfs_path_t& p = ls_[i];
+			if (zip_delete(m_zip_t, indexes[i]) == -1) {//.>only on the first one (read-only archive): a deleted entry can't be restored
+				zipfs_internal_assert(delete_count == 0);
 				_zipfs_zip_get_error_and_close(p, "");
 				return m_ze;
 			}
+			else if (!m_zipfs_index_t.erase(p)) {
+				zipfs_internal_assert(false);
+			}
+			_zipfs_pending_change(p);
 
 			delete_count++;
 		}
@@ -513,24 +711,38 @@ namespace zipfs {
 			_zipfs_open(ZIPFS_ZIP_FLAGS_NONE))
 			return m_ze;
 
-		for (zipfs_path_t& p : ls_) {
+		std::vector<zip_int64_t> indexes;//.>located first: a missing entry fails the operation before anything is renamed
+		for (const zipfs_path_t& p : ls_) {
 			zip_int64_t index = _zipfs_name_locate(p);
 			if (index == -1) {
-				_zipfs_unchange_all();
 				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, p, "");
 				return m_ze;
 			}
-			else {
-				zipfs_path_t rename_path = zipfs_rename_path + p.string().substr(zipfs_path.string().length());
-				if (zip_file_rename(m_zip_t, index, rename_path.libzip_path(), ZIPFS_ZIP_FL_ENC) == -1) {
-					_zipfs_unchange_all();
-					_zipfs_zip_get_error_and_close(rename_path, "");
-					return m_ze;
-				}
-				else if (!m_zipfs_index_t.rename(p, rename_path)) {
-					zipfs_internal_assert(false);
+			indexes.push_back(index);
+		}
+
+		for (size_t i = 0; i < ls_.size(); i++) {
+			const zipfs_path_t& p = ls_[i];
+			zipfs_path_t rename_path = zipfs_rename_path + p.string().substr(zipfs_path.string().length());
+			if (zip_file_rename(m_zip_t, indexes[i], rename_path.libzip_path(), ZIPFS_ZIP_FL_ENC) == -1) {//.>e.g. the name exists: the entries renamed so far get their name back
+				_zipfs_zip_get_error(rename_path, "");
+				for (size_t r = i; r-- > 0;) {
+					zipfs_path_t renamed_path = zipfs_rename_path + ls_[r].string().substr(zipfs_path.string().length());
+					if (zip_file_rename(m_zip_t, indexes[r], ls_[r].libzip_path(), ZIPFS_ZIP_FL_ENC) == -1 ||
+						!m_zipfs_index_t.rename(renamed_path, ls_[r])) {
+						zipfs_internal_assert(false);
+					}
+					_zipfs_pending_revert(renamed_path);
+					_zipfs_pending_revert(ls_[r]);
 				}
+				_zipfs_close();
+				return m_ze;
+			}
+			else if (!m_zipfs_index_t.rename(p, rename_path)) {
+				zipfs_internal_assert(false);
 			}
+			_zipfs_pending_change(p);
+			_zipfs_pending_change(rename_path);
 		}
 
 		_zipfs_no_error_and_close();
@@ -544,66 +756,96 @@ namespace zipfs {
 			_zipfs_open(ZIP_RDONLY))
 			return m_ze;
 
-		zip_int64_t index = _zipfs_name_locate(zipfs_path);
-		if (index == -1) {
-			_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, zipfs_path, "");
+		if (!_zipfs_cat(zipfs_path, result, read_compressed)) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::cat(const zipfs_path_t& zipfs_path, char* buffer, size_t byte_sz, size_t& result, bool read_compressed) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, read_compressed, index, size)) {
+			_zipfs_close();
 			return m_ze;
 		}
+
+		if (_zipfs_decrypt_cipher()) {//.>decrypted size is known once read
+			size_t total = 0;
+			if (!_zipfs_cat_chunks(zipfs_path, index, read_compressed, [buffer, byte_sz, &total](const char* data, size_t data_sz) {
+				if (total + data_sz <= byte_sz)
+					std::copy(data, data + data_sz, buffer + total);
+				total += data_sz;
+				return true;
+			})) {
+				_zipfs_close();
+				return m_ze;
+			}
+
+			result = total;
+			if (total > byte_sz) {
+				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_BUFFER_TOO_SMALL, zipfs_path, "");
+				return m_ze;
+			}
+		}
+		else if (!_zipfs_decrypt_func()) {
+			result = size;
+			if (size > byte_sz) {
+				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_BUFFER_TOO_SMALL, zipfs_path, "");
+				return m_ze;
+			}
+			else if (!_zipfs_cat_read(zipfs_path, index, buffer, size, read_compressed)) {
+				_zipfs_close();
+				return m_ze;
+			}
+		}
 		else {
-			zip_stat_t stat;
-			zip_stat_init(&stat);
-			if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
-				_zipfs_zip_get_error_and_close(zipfs_path, "");
+			m_cat_buffer.resize(size);
+			if (!_zipfs_cat_read(zipfs_path, index, m_cat_buffer.data(), size, read_compressed)) {
+				_zipfs_close();
 				return m_ze;
 			}
-			else if (!(stat.valid & ZIP_STAT_SIZE)) {
-				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_FILE_CANNOT_READ_SIZE, zipfs_path, "");
+
+			uint8_t* ret_buf = nullptr;
+			size_t ret_len;
+			m_file_decrypt_func(zipfs_path.c_str(), reinterpret_cast<uint8_t*>(m_cat_buffer.data()), m_cat_buffer.size(), &ret_buf, &ret_len);
+			result = ret_len;
+			if (ret_len <= byte_sz)
+				std::copy(ret_buf, ret_buf + ret_len, reinterpret_cast<uint8_t*>(buffer));
+			delete[] ret_buf;
+
+			if (ret_len > byte_sz) {
+				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_BUFFER_TOO_SMALL, zipfs_path, "");
 				return m_ze;
 			}
-			else {
-				zip_file_t* file = zip_fopen_index(m_zip_t, index, /*ZIPFS_FL_ENC*/ 0 | (read_compressed ? ZIP_FL_COMPRESSED : ZIPFS_ZIP_FLAGS_NONE));
-				if (file == nullptr) {
-					_zipfs_zip_get_error_and_close(zipfs_path, "");
-					return m_ze;
-				}
-				else {
-					std::vector<char> buf(stat.size);
-					zip_int64_t read = zip_fread(file, buf.data(), stat.size);
-					if (read == -1) {
-						zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
-						_zipfs_zip_get_error_and_close(zipfs_path, "");
-						return m_ze;
-					}
-					else if (read != stat.size) {
-						zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
-						_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
-						return m_ze;
-					}
-					else if (zip_fclose(file) != 0) {
-						_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_FILE_CANNOT_CLOSE, zipfs_path, "");
-						return m_ze;
-					}
-					else {
-
-						bool decrpt = m_file_decrypt && m_file_decrypt_func != nullptr;
-						switch (decrpt) {
-						case true: {//decryption
-							uint8_t* ret_buf = nullptr;
-							size_t ret_len;
-							{
-								m_file_decrypt_func(zipfs_path.c_str(), reinterpret_cast<uint8_t*>(buf.data()), buf.size(), &ret_buf, &ret_len);
-								result.assign(ret_buf, ret_buf + ret_len);
-							}
-							delete[] ret_buf;
-							break;
-						}
-						case false: {//no decryption
-							result = std::move(buf);
-							break;
-						}
-						}
-					}
-				}
+		}
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::cat(const std::vector<zipfs_path_t>& zipfs_paths, std::vector<std::vector<char>>& results, bool read_compressed) {
+		for (const zipfs_path_t& zipfs_path : zipfs_paths)
+			zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		results.resize(zipfs_paths.size());//.>results' vectors are reused
+		for (size_t p = 0; p < zipfs_paths.size(); p++) {
+			if (!_zipfs_cat(zipfs_paths[p], results[p], read_compressed)) {
+				_zipfs_close();
+				return m_ze;
 			}
 		}
 
@@ -611,33 +853,348 @@ namespace zipfs {
 		return m_ze;
 	}
 
-	zipfs_error_t zipfs_t::ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) {
-		zipfs_usage_assert(zipfs_path.is_dir(), ZIPFS_ERRSTR_DIRECTORY_PATH_EXPECTED);
+	zipfs_error_t zipfs_t::open_reader(const zipfs_path_t& zipfs_path, zipfs_reader_t& result, bool read_compressed) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		(void)result.close();
 
-		zip_int64_t num_entries_;
 		if (!
-			num_entries(num_entries_))
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, read_compressed, index, size)) {
+			_zipfs_close();
 			return m_ze;
-		
+		}
+
+		if (_zipfs_decrypt_func()) {//.>the decrypt function takes the whole file
+			if (!_zipfs_cat(zipfs_path, result.m_data, read_compressed)) {
+				_zipfs_close();
+				return m_ze;
+			}
+			result.m_size = result.m_data.size();
+			result.m_zipfs_path = zipfs_path;
+			result.m_open = true;
+
+			_zipfs_no_error_and_close();
+			return m_ze;
+		}
+
+		//.>own read-only archive: later changes don't affect the reader
+		zip_t* snapshot_zip = _zipfs_snapshot_open();
+		if (snapshot_zip == nullptr) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		zip_file_t* file = zip_fopen_index(snapshot_zip, index, /*ZIPFS_FL_ENC*/ 0 | (read_compressed ? ZIP_FL_COMPRESSED : ZIPFS_ZIP_FLAGS_NONE));
+		if (file == nullptr) {
+			m_ze = zip_get_error(snapshot_zip);
+			m_ze.set_zipfs_path(zipfs_path);
+			zip_discard(snapshot_zip);
+			_zipfs_close();
+			return m_ze;
+		}
+
+		if (_zipfs_decrypt_cipher()) {//.>decrypted chunk by chunk as it is read
+			result.m_cipher = m_file_decrypt_cipher;
+			result.m_state = m_file_decrypt_cipher.init(m_file_decrypt_cipher.context, zipfs_path.c_str());
+			if (result.m_state == nullptr) {
+				(void)zip_fclose(file);
+				zip_discard(snapshot_zip);
+				result.m_cipher = zipfs_cipher_t();
+				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CIPHER_ERROR, zipfs_path, "");
+				return m_ze;
+			}
+		}
+
+		result.m_zip_t = snapshot_zip;
+		result.m_zip_file_t = file;
+		result.m_size = size;
+		result.m_zipfs_path = zipfs_path;
+		result.m_open = true;
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::view(const zipfs_path_t& zipfs_path, zipfs_view_t& result) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
 		if (!
 			_zipfs_open(ZIP_RDONLY))
 			return m_ze;
 
-		result.clear();
-		for (zip_int64_t e = 0; e < num_entries_; e++) {
-			const char* name = zip_get_name(m_zip_t, e, ZIPFS_ZIP_FL_ENC);
-			if (name == nullptr) {
-				result.clear();
-				_zipfs_zip_get_error_and_close(zipfs_path, "");
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, false, index, size)) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		if (!_zipfs_view(zipfs_path, index, size, result)) {//.>copy
+			std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>();
+			if (!_zipfs_cat(zipfs_path, *data, false)) {
+				_zipfs_close();
 				return m_ze;
 			}
+			result = zipfs_view_t(std::shared_ptr<const char>(data, data->data()), data->size(), false);
+		}
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::cat_size(const zipfs_path_t& zipfs_path, size_t& result, bool read_compressed) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, read_compressed, index, size)) {
+			_zipfs_close();
+			return m_ze;
+		}
+		result = size;
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	bool zipfs_t::_zipfs_cat(const zipfs_path_t& zipfs_path, std::vector<char>& result, bool read_compressed) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, read_compressed, index, size))
+			return false;
+
+		if (_zipfs_decrypt_cipher()) {
+			result.clear();//.>capacity is kept
+			return _zipfs_cat_chunks(zipfs_path, index, read_compressed, [&result](const char* data, size_t data_sz) {
+				result.insert(result.end(), data, data + data_sz);
+				return true;
+			});
+		}
+
+		bool decrypt = _zipfs_decrypt_func();
+		std::vector<char>& buf = decrypt ? m_cat_buffer : result;//.>no reallocation if the capacity is enough
+		buf.resize(size);
+		if (!_zipfs_cat_read(zipfs_path, index, buf.data(), size, read_compressed))
+			return false;
+
+		if (decrypt) {
+			uint8_t* ret_buf = nullptr;
+			size_t ret_len;
+			{
+				m_file_decrypt_func(zipfs_path.c_str(), reinterpret_cast<uint8_t*>(buf.data()), buf.size(), &ret_buf, &ret_len);
+				result.assign(ret_buf, ret_buf + ret_len);
+			}
+			delete[] ret_buf;
+		}
+
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_cat_size(const zipfs_path_t& zipfs_path, bool read_compressed, zip_int64_t& index, zip_uint64_t& result) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		index = _zipfs_name_locate(zipfs_path);
+		if (index == -1) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, zipfs_path, "");
+			return false;
+		}
+
+		zip_stat_t stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+		else if (!(stat.valid & (read_compressed ? ZIP_STAT_COMP_SIZE : ZIP_STAT_SIZE))) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_SIZE, zipfs_path, "");
+			return false;
+		}
+
+		result = read_compressed ? stat.comp_size : stat.size;
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_view(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_uint64_t byte_sz, zipfs_view_t& result) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		if (_zipfs_file_backed() || _zipfs_decrypt_func() || _zipfs_decrypt_cipher())
+			return false;
+		else if (std::find(m_pending_changes.begin(), m_pending_changes.end(), zipfs_path) != m_pending_changes.end())//.>session: not in the source data yet
+			return false;
+
+		zip_stat_t stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1)
+			return false;
+		else if ((stat.valid & (ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC)) != (ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC))
+			return false;
+		else if (stat.comp_method != ZIP_CM_STORE || stat.encryption_method != ZIP_EM_NONE || stat.comp_size != byte_sz)
+			return false;
+
+		//.>the source data's central directory lists entries in index order; parsed once per generation
+		const zipfs_buffer_t& source = m_zipfs_buffer_source_t->buffer();
+		if (!m_view_cdir_parsed || m_view_cdir_generation != m_generation) {
+			m_view_cdir.reset(new zipfs_cdir_t());
+			if (!m_view_cdir->parse(source))
+				m_view_cdir.reset(new zipfs_cdir_t());//.>zip64 or prepended archive: copies from now on
+			m_view_cdir_parsed = true;
+			m_view_cdir_generation = m_generation;
+		}
+
+		if (static_cast<zip_uint64_t>(index) >= m_view_cdir->records().size())
+			return false;
+
+		const zipfs_cdir_t::record_t& record = m_view_cdir->records()[index];
+		zip_uint64_t data_offset;
+		if (record.compressed_size() != byte_sz || record.crc() != stat.crc)
+			return false;
+		else if (!zipfs_cdir_t::data_offset(source, record, data_offset))
+			return false;
+
+		std::shared_ptr<const char> data;
+		if (byte_sz != 0 && !source.span(data_offset, byte_sz, data))//.>crosses segments
+			return false;
+
+		result = zipfs_view_t(data, byte_sz, true);
+		return true;
+	}
+
+	zip_t* zipfs_t::_zipfs_snapshot_open() {
+		zip_error_t ze;
+		zip_error_init(&ze);
+		zipfs_buffer_source_t* snapshot_buffer;
+		zip_source_t* snapshot_src = _zipfs_file_backed() ?
+			zip_source_file_create(m_fs_path.u8path().c_str(), 0, -1, &ze) :
+			zipfs_buffer_source_t::create(m_zipfs_buffer_source_t->buffer(), &snapshot_buffer, &ze);
+		zip_t* snapshot_zip = snapshot_src != nullptr ? zip_open_from_source(snapshot_src, ZIP_RDONLY, &ze) : nullptr;
+		if (snapshot_zip == nullptr) {
+			if (snapshot_src != nullptr)
+				(void)zip_source_free(snapshot_src);
+			m_ze = &ze;
+		}
+		zip_error_fini(&ze);
+		return snapshot_zip;
+	}
+
+	bool zipfs_t::_zipfs_cat_chunks(const zipfs_path_t& zipfs_path, zip_int64_t index, bool read_compressed, const std::function<bool(const char* data, size_t byte_sz)>& sink) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		return _zipfs_zip_file_chunks(m_zip_t, index, read_compressed, zipfs_path, _zipfs_decrypt_cipher() ? &m_file_decrypt_cipher : nullptr, m_cat_buffer, m_cat_cipher_buffer, sink, m_ze);
+	}
+
+	bool zipfs_t::_zipfs_zip_file_chunks(zip_t* zip, zip_int64_t index, bool read_compressed, const zipfs_path_t& zipfs_path, const zipfs_cipher_t* cipher,
+		std::vector<char>& in, std::vector<char>& out, const std::function<bool(const char* data, size_t byte_sz)>& sink, zipfs_error_t& ze) {
+		zip_file_t* file = zip_fopen_index(zip, index, /*ZIPFS_FL_ENC*/ 0 | (read_compressed ? ZIP_FL_COMPRESSED : ZIPFS_ZIP_FLAGS_NONE));
+		if (file == nullptr) {
+			ze = zip_get_error(zip);
+			ze.set_zipfs_path(zipfs_path);
+			return false;
+		}
+
+		void* state = nullptr;
+		if (cipher != nullptr && (state = cipher->init(cipher->context, zipfs_path.c_str())) == nullptr) {
+			zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+			ze = ZIPFS_ERRSTR_CIPHER_ERROR;
+			ze.set_zipfs_path(zipfs_path);
+			return false;
+		}
+
+		bool ok = true;
+		in.resize(1 << 16);
+		for (bool more = true; more;) {
+			zip_int64_t read = zip_fread(file, in.data(), in.size());
+			if (read == -1) {
+				ze = zip_file_get_error(file);
+				ze.set_zipfs_path(zipfs_path);
+				ok = false;
+				break;
+			}
+			else if (cipher == nullptr) {
+				more = read != 0 && sink(in.data(), static_cast<size_t>(read));
+				continue;
+			}
+
+			out.clear();
+			bool updated;
+			if (read != 0)
+				updated = cipher->update(state, reinterpret_cast<const uint8_t*>(in.data()), static_cast<size_t>(read), out);
+			else {
+				updated = cipher->final(state, out);//.>releases the state
+				state = nullptr;
+			}
+			if (!updated) {
+				ze = ZIPFS_ERRSTR_CIPHER_ERROR;
+				ze.set_zipfs_path(zipfs_path);
+				ok = false;
+				break;
+			}
 
-			std::string name_ = name;
-			bool found = name_.find(zipfs_path.libzip_path()) == 0;
-			if (!strict && found || strict && found && name_ != zipfs_path.libzip_path())
-				result.push_back("/" + std::string(name));
+			more = out.empty() || sink(out.data(), out.size());
+			more = more && read != 0;
+		}
+
+		if (state != nullptr) {//.>stopped early or failed
+			std::vector<char> discard;
+			(void)cipher->final(state, discard);
+		}
+		if (zip_fclose(file) != 0 && ok) {
+			ze = ZIPFS_ERRSTR_FILE_CANNOT_CLOSE;
+			ze.set_zipfs_path(zipfs_path);
+			ok = false;
+		}
+		return ok;
+	}
+
+	bool zipfs_t::_zipfs_cat_read(const zipfs_path_t& zipfs_path, zip_int64_t index, char* buffer, zip_uint64_t byte_sz, bool read_compressed) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		zip_file_t* file = zip_fopen_index(m_zip_t, index, /*ZIPFS_FL_ENC*/ 0 | (read_compressed ? ZIP_FL_COMPRESSED : ZIPFS_ZIP_FLAGS_NONE));
+		if (file == nullptr) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+
+		zip_int64_t read = zip_fread(file, buffer, byte_sz);
+		if (read == -1) {
+			zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+		else if (static_cast<zip_uint64_t>(read) != byte_sz) {
+			zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
+			return false;
+		}
+		else if (zip_fclose(file) != 0) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_CLOSE, zipfs_path, "");
+			return false;
 		}
 
+		return true;
+	}
+
+	zipfs_error_t zipfs_t::ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) {
+		zipfs_usage_assert(zipfs_path.is_dir(), ZIPFS_ERRSTR_DIRECTORY_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		result.clear();
+		m_zipfs_index_t.ls(zipfs_path, result, strict);//.>walks the zipfs_path subtree only
+
 		_zipfs_no_error_and_close();
 		return m_ze;
 	}
@@ -694,9 +1251,22 @@ namespace zipfs {
 	}
 
 	zipfs_error_t zipfs_t::get_source(std::vector<char>& result) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		if (!_zipfs_file_backed()) {//.>read the segments directly, no zip_source_t round trip
+			m_zipfs_buffer_source_t->buffer().copy_to(result);
+
+			m_ze = zipfs_error_t::no_error();
+			return m_ze;
+		}
+
 		zip_stat_t stat;
 		result = {};
 		if (zip_source_stat(m_zip_source_t, &stat) == -1) {
+			if (zip_error_code_zip(zip_source_error(m_zip_source_t)) == ZIP_ER_NOENT) {//.>file doesn't exist (yet)
+				m_ze = zipfs_error_t::no_error();
+				return m_ze;
+			}
 			_zipfs_zip_source_error();
 			return m_ze;
 		}
@@ -739,54 +1309,126 @@ namespace zipfs {
 		m_compression_flags = compression_flags;
 	}
 
+	void zipfs_t::set_alignment(zip_uint64_t alignment) {
+		zipfs_usage_assert(alignment <= 0x8000 && (alignment & (alignment - 1)) == 0, ZIPFS_ERRSTR_INVALID_ALIGNMENT);
+
+		m_alignment = alignment;
+	}
+
+	void zipfs_t::set_memory_budget(zip_uint64_t byte_sz) {
+		m_memory_budget = byte_sz;
+		if (m_zipfs_buffer_source_t != nullptr)
+			m_zipfs_buffer_source_t->set_memory_budget(byte_sz);
+	}
+
+	void zipfs_t::set_commit_mode(COMMIT_MODE commit_mode) {
+		m_commit_mode = commit_mode;
+	}
+
 	zipfs_error_t zipfs_t::zipfs_image_has_modifications(bool& result) {
-		std::vector<char> buf;
-		if (!
-			get_source(buf)) {
-			result = (bool)-1;
-			return m_ze;
-		}
-		
-		if (buf.size() != m_zip_source_t_image_user.size()) {
-			result = true;
-		}
-		else {
-			for (size_t b = 0; b < buf.size(); b++) {
-				if (buf[b] != m_zip_source_t_image_user[b]) {
-					result = true;
-					break;
-				}
-			}
-			result = false;
-		}
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		result = m_generation != m_generation_image_user;
+#ifdef _DEBUG
+		zipfs_internal_assert(result || _zipfs_file_backed() || m_zipfs_buffer_source_t->buffer().equals(m_zip_source_t_image_user));
+#endif
 
 		return zipfs_error_t::no_error();
 	}
 
+	zipfs_error_t zipfs_t::zipfs_image_modifications(std::vector<zipfs_path_t>& result) const {
+		result.assign(m_image_modifications.begin(), m_image_modifications.end());
+		return zipfs_error_t::no_error();
+	}
+
 	zipfs_error_t zipfs_t::zipfs_revert_to_image() {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+		zipfs_usage_assert(!_zipfs_file_backed(), ZIPFS_ERRSTR_ARCHIVE_IS_FILE_BACKED);
+
 		_zipfs_source_free();
 		if (!
-			_zipfs_source_new(m_zip_source_t_image_user.data(), m_zip_source_t_image_user.size()))
+			_zipfs_source_new(m_zip_source_t_image_user))
 			return m_ze;
 
-		m_zipfs_index_t = m_zipfs_index_t_image_user;
+		m_zipfs_index_t.clear();//.>rebuilt on next open
+		m_generation = m_generation_image_user;
+		m_view_cdir_parsed = false;//.>generation is reused
+		m_image_modifications.clear();
 
 		return zipfs_error_t::no_error();
 	}
 
 	zipfs_error_t zipfs_t::zipfs_image_update() {
-		std::vector<char> buf;
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		if (!_zipfs_file_backed())
+			m_zip_source_t_image_user = m_zipfs_buffer_source_t->buffer();
+		m_generation_image_user = m_generation;
+		m_image_modifications.clear();
+
+		return zipfs_error_t::no_error();
+	}
+
+	zipfs_error_t zipfs_t::session_begin() {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
 		if (!
-			get_source(buf))
+			_zipfs_open(ZIPFS_ZIP_FLAGS_NONE))
 			return m_ze;
 
-		m_zip_source_t_image_user.clear();
-		m_zip_source_t_image_user.assign(buf.data(), buf.data() + buf.size());
-		m_zipfs_index_t_image_user = m_zipfs_index_t;
+		m_session = true;
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::session_commit() {
+		zipfs_usage_assert(m_session, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		m_session = false;
+		_zipfs_error_init();
+
+		(void)_zipfs_commit();//.>on error, pending changes are lost
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::session_discard() {
+		zipfs_usage_assert(m_session, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		m_session = false;
+		_zipfs_error_init();
+
+		(void)zip_source_keep(m_zip_source_t);//ref++
+		zip_discard(m_zip_t);
 
+		m_zip_t = nullptr;
+		m_zipfs_index_t.clear();//.>rebuilt on next open
+		_zipfs_pending_clear();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::session_rollback() {
+		zipfs_usage_assert(m_session, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		_zipfs_error_init();
+		_zipfs_unchange_all();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::session_pending_changes(std::vector<zipfs_path_t>& result) const {
+		zipfs_usage_assert(m_session, ZIPFS_ERRSTR_SESSION_NOT_ACTIVE);
+
+		result = m_pending_changes;
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
 		return zipfs_error_t::no_error();
 	}
 
+	bool zipfs_t::session_is_active() const {
+		return m_session;
+	}
+
 	void zipfs_t::set_file_encrypt(bool encrypt) {
 		m_file_encrypt = encrypt;
 	}
@@ -799,6 +1441,14 @@ namespace zipfs {
 		m_file_encrypt_func = f;
 	}
 
+	void zipfs_t::set_file_encrypt_cipher(const zipfs_cipher_t& cipher) {
+		m_file_encrypt_cipher = cipher;
+	}
+
+	void zipfs_t::set_file_decrypt_cipher(const zipfs_cipher_t& cipher) {
+		m_file_decrypt_cipher = cipher;
+	}
+
 	void zipfs_t::set_file_decrypt_func(file_decrypt_func f) {
 		m_file_decrypt_func = f;
 	}
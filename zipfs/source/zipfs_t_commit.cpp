@@ -0,0 +1,447 @@
+#include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <zipfs/zipfs_cdir_t.h>
+#include <zipfs/zipfs_error_strings.h>
+#include <set>
+#include <algorithm>
+#include <cstring>
+
+namespace zipfs {
+
+	bool zipfs_t::_zipfs_commit() {//writes pending changes and closes m_zip_t; on error m_zip_t is discarded and m_ze is set
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		(void)zip_source_keep(m_zip_source_t);//ref++
+
+		if (m_commit_mode == COMMIT_MODE::APPEND && !m_pending_changes.empty() && !_zipfs_file_backed()) {
+			zipfs_buffer_t buffer;
+			bool append;
+			if (!_zipfs_commit_append(buffer, append)) {
+				zip_discard(m_zip_t);
+				m_zip_t = nullptr;
+				m_zipfs_index_t.clear();
+				_zipfs_pending_clear();
+				return false;
+			}
+			else if (append) {
+				zip_discard(m_zip_t);//.>changes are in buffer
+				m_zip_t = nullptr;
+				m_zipfs_index_t.clear();//.>kept entries come first, appended ones after: rebuilt on next open
+				_zipfs_pending_changes_written();
+				(void)_zipfs_commit_align(buffer);
+				_zipfs_source_free();
+				return _zipfs_source_new(buffer);
+			}
+		}
+
+		bool written = !m_pending_changes.empty();
+		m_cipher_failed.clear();
+		if (zip_close(m_zip_t) == -1) {
+			m_ze = zip_get_error(m_zip_t);
+			if (!m_cipher_failed.empty()) {//.>a user cipher returned false: not a libzip error
+				m_ze = ZIPFS_ERRSTR_CIPHER_ERROR;
+				m_ze.set_zipfs_path(m_cipher_failed);
+			}
+			else if (_zipfs_file_backed())//.>full disk, read-only directory, archive removed: names the archive
+				m_ze.set_fs_path(m_fs_path);
+			zip_discard(m_zip_t);
+			m_zip_t = nullptr;
+			m_zipfs_index_t.clear();
+			_zipfs_pending_clear();
+			return false;
+		}
+
+		m_zip_t = nullptr;
+		m_zipfs_index_t.commit();//.>index is kept alive, entries are renumbered past deletions
+		_zipfs_pending_changes_written();
+
+		if (written && !_zipfs_file_backed()) {
+			zipfs_buffer_t buffer = m_zipfs_buffer_source_t->buffer();
+			if (_zipfs_commit_align(buffer)) {
+				_zipfs_source_free();
+				return _zipfs_source_new(buffer);
+			}
+		}
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_commit_align(zipfs_buffer_t& buffer) {//true if buffer was realigned; entry order and indexes don't change
+		zipfs_buffer_t aligned;
+		if (m_alignment == 0 || !zipfs_cdir_t::align(buffer, m_alignment, aligned))
+			return false;
+
+		buffer = aligned;
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_zip_file_meta_copy(zip_t* zip, zip_uint64_t index, zip_t* dest_zip, zip_uint64_t dest_index) {
+		auto error = [zip, dest_zip]() {
+			zip_error_t* ze = zip_get_error(zip);
+			zip_error_set(zip_get_error(dest_zip), zip_error_code_zip(ze), zip_error_code_system(ze));
+			return false;
+		};
+
+		zip_uint8_t opsys;
+		zip_uint32_t attributes;
+		if (zip_file_get_external_attributes(zip, index, ZIPFS_ZIP_FLAGS_NONE, &opsys, &attributes) == -1)
+			return error();
+		else if (zip_file_set_external_attributes(dest_zip, dest_index, ZIPFS_ZIP_FLAGS_NONE, opsys, attributes) == -1)
+			return false;
+
+		zip_uint32_t comment_len;
+		const char* comment = zip_file_get_comment(zip, index, &comment_len, ZIP_FL_ENC_RAW);
+		if (comment == nullptr)
+			return error();
+		else if (comment_len != 0 && zip_file_set_comment(dest_zip, dest_index, comment, static_cast<zip_uint16_t>(comment_len), ZIPFS_ZIP_FLAGS_NONE) == -1)
+			return false;
+
+		for (zip_flags_t where : { ZIP_FL_CENTRAL, ZIP_FL_LOCAL }) {//.>libzip's own fields (zip64, UTF-8 names) aren't listed
+			zip_int16_t count = zip_file_extra_fields_count(zip, index, where);
+			if (count == -1)
+				return error();
+
+			for (zip_uint16_t f = 0; f < static_cast<zip_uint16_t>(count); f++) {
+				zip_uint16_t id, len;
+				const zip_uint8_t* data = zip_file_extra_field_get(zip, index, f, &id, &len, where);
+				if (data == nullptr)
+					return error();
+				else if (id == 0xd935)//.>zipalign padding, redone by _zipfs_commit_align()
+					continue;
+				else if (zip_file_extra_field_set(dest_zip, dest_index, id, ZIP_EXTRA_FIELD_NEW, data, len, where) == -1)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_commit_append(zipfs_buffer_t& result, bool& append) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+		append = false;
+
+		const zipfs_buffer_t& source = m_zipfs_buffer_source_t->buffer();
+		zipfs_cdir_t cdir;
+		if (!cdir.parse(source))//.>new, zip64 or prepended archive: rewrite
+			return true;
+
+		zip_int64_t num_entries = zip_get_num_entries(m_zip_t, ZIPFS_ZIP_FLAGS_NONE);
+		zip_int64_t num_records = static_cast<zip_int64_t>(cdir.records().size());
+		std::set<zipfs_path_t> changes(m_pending_changes.begin(), m_pending_changes.end());
+
+		//.>zip64 limits, checked before any source is read: pending sources (writer, cipher, deflated) can't be read a second time by a rewrite
+		zip_uint64_t append_bound = cdir.offset() + cdir.size();
+		for (zip_int64_t e = 0; e < num_entries; e++) {
+			const char* name = zip_get_name(m_zip_t, e, ZIPFS_ZIP_FL_ENC);
+			if (name == nullptr) {//deleted
+				zip_error_clear(m_zip_t);
+				continue;
+			}
+			else if (e < num_records && changes.count("/" + std::string(name)) == 0)
+				continue;
+
+			zip_stat_t stat;
+			zip_stat_init(&stat);
+			if (zip_stat_index(m_zip_t, e, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+				zip_error_clear(m_zip_t);
+				return true;
+			}
+			else if (!(stat.valid & ZIP_STAT_SIZE))//.>size known once read (cipher source): libzip may write zip64 fields
+				return true;
+
+			zip_uint64_t data_size = (stat.valid & ZIP_STAT_COMP_SIZE) ? std::max(stat.size, stat.comp_size) : stat.size;
+			append_bound += data_size + (data_size >> 8) + 2 * std::strlen(name) + 0x100;//.>deflate overhead, local header, data descriptor, central record
+		}
+		if (append_bound >= 0xffffffff || num_entries >= 0xffff)
+			return true;
+
+		//.>archive of the changed entries, spliced in place of the central directory
+		zip_error_t ze;
+		zip_error_init(&ze);
+
+		zipfs_buffer_source_t* append_buffer = nullptr;
+		zip_source_t* append_src = zipfs_buffer_source_t::create(zipfs_buffer_t(), &append_buffer, &ze);
+		zip_t* append_zip = append_src != nullptr ? zip_open_from_source(append_src, ZIPFS_ZIP_FLAGS_NONE, &ze) : nullptr;
+		if (append_zip == nullptr) {
+			if (append_src != nullptr)
+				(void)zip_source_free(append_src);
+			m_ze = &ze;
+			zip_error_fini(&ze);
+			return false;
+		}
+		(void)zip_source_keep(append_src);//ref++, read after zip_close()
+		append_buffer->set_memory_budget(m_memory_budget);
+
+		zip_t* source_zip = nullptr;//.>read-only view of the source data; renamed or re-dated entries are copied raw from it
+
+		auto discard = [&](zip_error_t* error) {
+			if (error != nullptr)
+				m_ze = error;
+			zip_discard(append_zip);
+			if (source_zip != nullptr)
+				zip_discard(source_zip);
+			(void)zip_source_free(append_src);
+			zip_error_fini(&ze);
+			return error == nullptr;
+		};
+
+		std::vector<zip_int64_t> kept;//.>unchanged entries, their data stays in place
+		for (zip_int64_t e = 0; e < num_entries; e++) {
+			const char* name = zip_get_name(m_zip_t, e, ZIPFS_ZIP_FL_ENC);
+			if (name == nullptr) {//deleted
+				zip_error_clear(m_zip_t);
+				continue;
+			}
+
+			zipfs_path_t zipfs_path = "/" + std::string(name);
+			if (e < num_records && changes.count(zipfs_path) == 0) {
+				kept.push_back(e);
+				continue;
+			}
+
+			zip_int64_t index;
+			auto pending_source = m_pending_sources.find(e);
+			if (pending_source != m_pending_sources.end()) {//new data
+				zip_source_t* src = pending_source->second.src;
+				(void)zip_source_keep(src);//ref++
+				if ((index = zip_file_add(append_zip, name, src, ZIPFS_ZIP_FL_ENC)) == -1) {
+					(void)zip_source_free(src);
+					return discard(zip_get_error(append_zip));
+				}
+				else if (zip_set_file_compression(append_zip, index, pending_source->second.compression, pending_source->second.compression_flags) == -1) {
+					return discard(zip_get_error(append_zip));
+				}
+			}
+			else if (zipfs_path.is_dir()) {
+				if ((index = zip_dir_add(append_zip, zipfs_path.libzip_path_dir_add().c_str(), ZIPFS_ZIP_FL_ENC)) == -1)
+					return discard(zip_get_error(append_zip));
+			}
+			else {//renamed or re-dated entry
+				zipfs_internal_assert(e < num_records);
+				if (source_zip == nullptr) {
+					zipfs_buffer_source_t* source_buffer;
+					zip_source_t* src = zipfs_buffer_source_t::create(source, &source_buffer, &ze);
+					if (src == nullptr)
+						return discard(&ze);
+					else if ((source_zip = zip_open_from_source(src, ZIP_RDONLY, &ze)) == nullptr) {
+						(void)zip_source_free(src);
+						return discard(&ze);
+					}
+				}
+
+				zip_source_t* src = zip_source_zip(append_zip, source_zip, e, ZIP_FL_COMPRESSED, 0, -1);
+				if (src == nullptr)
+					return discard(zip_get_error(append_zip));
+				else if ((index = zip_file_add(append_zip, name, src, ZIPFS_ZIP_FL_ENC)) == -1) {
+					(void)zip_source_free(src);
+					return discard(zip_get_error(append_zip));
+				}
+			}
+
+			zip_stat_t stat;
+			zip_stat_init(&stat);
+			if (zip_stat_index(m_zip_t, e, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+				zip_error_clear(m_zip_t);
+			}
+			else if ((stat.valid & ZIP_STAT_MTIME) && zip_file_set_mtime(append_zip, index, stat.mtime, ZIPFS_ZIP_FLAGS_NONE) == -1) {
+				return discard(zip_get_error(append_zip));
+			}
+
+			if (!_zipfs_zip_file_meta_copy(m_zip_t, e, append_zip, index))
+				return discard(zip_get_error(append_zip));
+		}
+
+		zip_int64_t num_appended = zip_get_num_entries(append_zip, ZIPFS_ZIP_FLAGS_NONE);
+		if (kept.empty() && num_appended == 0)//.>archive is emptied: rewrite
+			return discard(nullptr);
+
+		if (zip_close(append_zip) == -1)
+			return discard(zip_get_error(append_zip));
+		append_zip = nullptr;
+		if (source_zip != nullptr)
+			zip_discard(source_zip);
+		source_zip = nullptr;
+
+		//.>the pending sources are read: no falling back to a rewrite from here, the zip64 limits were checked first
+		zipfs_cdir_t append_cdir;
+		bool write = (num_appended == 0 || append_cdir.parse(append_buffer->buffer())) && cdir.offset() + append_cdir.offset() < 0xffffffff;
+
+		//.>central directory: kept records as is, then the appended ones moved past the kept data
+		std::vector<zipfs_cdir_t::record_t> records;
+		std::vector<char> cdir_data;
+		if (write) {
+			records.reserve(kept.size() + append_cdir.records().size());
+			for (zip_int64_t e : kept)
+				records.push_back(cdir.records()[e]);
+			for (zipfs_cdir_t::record_t record : append_cdir.records()) {
+				record.set_local_header_offset(record.local_header_offset() + cdir.offset());
+				records.push_back(std::move(record));
+			}
+			write = zipfs_cdir_t::write(records, cdir.offset() + append_cdir.offset(), cdir.comment(), cdir_data);
+		}
+
+		if (write) {
+			result = source.prefix(cdir.offset());
+			result.append(append_buffer->buffer().prefix(append_cdir.offset()));
+			result.append(std::move(cdir_data));
+			append = true;
+		}
+		else {
+			zip_error_set(&ze, ZIP_ER_INTERNAL, 0);
+			m_ze = &ze;
+		}
+
+		(void)zip_source_free(append_src);
+		zip_error_fini(&ze);
+		return write;
+	}
+
+	zipfs_error_t zipfs_t::compact(zip_int64_t& reclaimed) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+		zipfs_internal_assert(m_zip_t == nullptr);
+
+		_zipfs_error_init();
+		reclaimed = 0;
+
+		if (_zipfs_file_backed())//.>always rewritten, no dead space
+			return m_ze;
+
+		const zipfs_buffer_t& source = m_zipfs_buffer_source_t->buffer();
+		if (source.empty())
+			return m_ze;
+
+		zip_error_t ze;
+		zip_error_init(&ze);
+
+		zipfs_buffer_source_t* source_buffer;
+		zip_source_t* source_src = zipfs_buffer_source_t::create(source, &source_buffer, &ze);
+		zip_t* source_zip = source_src != nullptr ? zip_open_from_source(source_src, ZIP_RDONLY, &ze) : nullptr;
+		if (source_zip == nullptr) {
+			if (source_src != nullptr)
+				(void)zip_source_free(source_src);
+			m_ze = &ze;
+			zip_error_fini(&ze);
+			return m_ze;
+		}
+
+		zipfs_buffer_source_t* compact_buffer;
+		zip_source_t* compact_src = zipfs_buffer_source_t::create(zipfs_buffer_t(), &compact_buffer, &ze);
+		zip_t* compact_zip = compact_src != nullptr ? zip_open_from_source(compact_src, ZIPFS_ZIP_FLAGS_NONE, &ze) : nullptr;
+		if (compact_zip == nullptr) {
+			if (compact_src != nullptr)
+				(void)zip_source_free(compact_src);
+			zip_discard(source_zip);
+			m_ze = &ze;
+			zip_error_fini(&ze);
+			return m_ze;
+		}
+		(void)zip_source_keep(compact_src);//ref++, read after zip_close()
+		compact_buffer->set_memory_budget(m_memory_budget);
+
+		auto discard = [&](zip_error_t* error) {
+			m_ze = error;
+			if (compact_zip != nullptr)
+				zip_discard(compact_zip);
+			zip_discard(source_zip);
+			(void)zip_source_free(compact_src);
+			zip_error_fini(&ze);
+			return m_ze;
+		};
+
+		//.>live entries, in order: indexes don't change
+		zip_int64_t num_entries = zip_get_num_entries(source_zip, ZIPFS_ZIP_FLAGS_NONE);
+		for (zip_int64_t e = 0; e < num_entries; e++) {
+			const char* name = zip_get_name(source_zip, e, ZIPFS_ZIP_FL_ENC);
+			if (name == nullptr)
+				return discard(zip_get_error(source_zip));
+
+			zipfs_path_t zipfs_path = "/" + std::string(name);
+			zip_int64_t index;
+			if (zipfs_path.is_dir()) {
+				if ((index = zip_dir_add(compact_zip, zipfs_path.libzip_path_dir_add().c_str(), ZIPFS_ZIP_FL_ENC)) == -1)
+					return discard(zip_get_error(compact_zip));
+			}
+			else {
+				zip_source_t* src = zip_source_zip(compact_zip, source_zip, e, ZIP_FL_COMPRESSED, 0, -1);
+				if (src == nullptr)
+					return discard(zip_get_error(compact_zip));
+				else if ((index = zip_file_add(compact_zip, name, src, ZIPFS_ZIP_FL_ENC)) == -1) {
+					(void)zip_source_free(src);
+					return discard(zip_get_error(compact_zip));
+				}
+			}
+
+			zip_stat_t stat;
+			zip_stat_init(&stat);
+			if (zip_stat_index(source_zip, e, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1)
+				return discard(zip_get_error(source_zip));
+			else if ((stat.valid & ZIP_STAT_MTIME) && zip_file_set_mtime(compact_zip, index, stat.mtime, ZIPFS_ZIP_FLAGS_NONE) == -1)
+				return discard(zip_get_error(compact_zip));
+			else if (!_zipfs_zip_file_meta_copy(source_zip, e, compact_zip, index))
+				return discard(zip_get_error(compact_zip));
+		}
+
+		int comment_len;
+		const char* comment = zip_get_archive_comment(source_zip, &comment_len, ZIP_FL_ENC_RAW);
+		if (comment != nullptr && comment_len > 0 && zip_set_archive_comment(compact_zip, comment, static_cast<zip_uint16_t>(comment_len)) == -1)
+			return discard(zip_get_error(compact_zip));
+
+		if (zip_close(compact_zip) == -1)
+			return discard(zip_get_error(compact_zip));
+		compact_zip = nullptr;
+		zip_discard(source_zip);
+
+		zipfs_buffer_t buffer = compact_buffer->buffer();
+		(void)zip_source_free(compact_src);
+		zip_error_fini(&ze);
+		(void)_zipfs_commit_align(buffer);//.>data offsets changed
+
+		reclaimed = static_cast<zip_int64_t>(source.size()) - static_cast<zip_int64_t>(buffer.size());
+		_zipfs_source_free();
+		if (!
+			_zipfs_source_new(buffer))
+			return m_ze;
+
+		m_generation++;//.>same entries, new data
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::dead_space(zip_uint64_t& result) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		_zipfs_error_init();
+		result = 0;
+
+		if (_zipfs_file_backed())//.>always rewritten, no dead space
+			return m_ze;
+
+		const zipfs_buffer_t& source = m_zipfs_buffer_source_t->buffer();
+		zipfs_cdir_t cdir;
+		if (!cdir.parse(source))//.>empty or zip64 archive: not measured
+			return m_ze;
+
+		zip_uint64_t live = source.size() - cdir.offset();//.>central directory and end record
+		for (const zipfs_cdir_t::record_t& record : cdir.records()) {
+			zip_uint64_t entry_size;
+			if (!zipfs_cdir_t::entry_size(source, record, entry_size)) {
+				m_ze = ZIPFS_ERRSTR_INVALID_LOCAL_HEADER;
+				return m_ze;
+			}
+			live += entry_size;
+		}
+
+		result = live < source.size() ? source.size() - live : 0;
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::dead_space_ratio(double& result) {
+		zip_uint64_t dead_space_;
+		if (!
+			dead_space(dead_space_))
+			return m_ze;
+
+		zip_uint64_t size = _zipfs_file_backed() ? 0 : m_zipfs_buffer_source_t->buffer().size();
+		result = size != 0 ? static_cast<double>(dead_space_) / static_cast<double>(size) : 0.0;
+		return m_ze;
+	}
+}
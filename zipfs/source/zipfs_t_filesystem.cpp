@@ -2,8 +2,19 @@
 #include <zipfs/zipfs_assert.h>
 #include <zipfs/zipfs_error_strings.h>
 #include <zipfs/zipfs_filesystem_path_t.h>
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <zipfs/zipfs_cipher_source_t.h>
+#include <zipfs/zipfs_deflated_source_t.h>
+#include <zipfs/zipfs_deflate_t.h>
+#include <zipfs/zipfs_block_deflate_t.h>
+#include <zipfs/zipfs_spill_file_t.h>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace zipfs {
 
@@ -69,7 +80,11 @@ namespace zipfs {
 		//pull first, then orphans
 	pull_from_query_results:
 		{
-			for (const auto& qr : query_results_.m_query_results) {
+			if (m_pull_threads > 1) {
+				if (!_zipfs_dir_pull_parallel(query_results_))
+					goto abort;
+			}
+			else for (const auto& qr : query_results_.m_query_results) {
 				switch (qr.query_result) {
 				case QUERY_RESULT::FILE_WRITE:
 				case QUERY_RESULT::FILE_OVERWRITE: {
@@ -178,7 +193,11 @@ namespace zipfs {
 	extract_from_query_results:
 		{
 			//extract
-			for (const auto& qr : query_results_.m_query_results) {
+			if (m_extract_threads > 1 && !m_session) {
+				if (!_zipfs_dir_extract_parallel(query_results_))
+					goto abort;
+			}
+			else for (const auto& qr : query_results_.m_query_results) {
 				switch (qr.query_result) {
 				case QUERY_RESULT::DIR_ADD: {
 					if (!std::filesystem::create_directory(qr.fs_path.platform_path()))//assumes ls() doesn't list a nested directory before its parent
@@ -218,6 +237,445 @@ namespace zipfs {
 		return true;
 	}
 
+	struct zipfs_t::pull_job_t {
+
+		const zipfs_query_result_t*
+			query_result;
+
+		std::vector<char> //read, encrypted and compressed; released once spilled
+			data;
+
+		zip_uint64_t
+			size = 0,//.>uncompressed
+			spill_size = 0;//.>data size, in the spill region
+
+		zip_uint32_t
+			crc = 0;
+
+		time_t
+			mtime = 0;
+
+		bool
+			ready = false,
+			blocks = false;//.>left to the archive thread: deflated in blocks, as dir_pull() does on one thread
+
+		zipfs_error_t
+			ze = zipfs_error_t::no_error();
+	};
+
+	bool zipfs_t::_zipfs_dir_pull_parallel(const zipfs_query_results_t& query_results) {
+		//.>deflate is done by the workers, libzip copies the data; other methods are left to libzip
+		bool deflate = m_compression == ZIP_CM_DEFLATE || m_compression == ZIP_CM_DEFAULT;
+
+		std::vector<pull_job_t> jobs;
+		for (const auto& qr : query_results.m_query_results) {
+			if (qr.query_result == QUERY_RESULT::FILE_WRITE || qr.query_result == QUERY_RESULT::FILE_OVERWRITE) {
+				jobs.emplace_back();
+				jobs.back().query_result = &qr;
+			}
+		}
+
+		//.>bounded: workers stay at most window files, and max_ready bytes of prepared data, ahead of the archive
+		size_t threads = std::min<size_t>(m_pull_threads, std::max<size_t>(jobs.size(), 1));
+		size_t window = 2 * threads;
+		const zip_uint64_t max_ready = zip_uint64_t(1) << 26;
+		size_t next = 0, added = 0;
+		zip_uint64_t ready = 0;
+		bool stop = false;
+		std::mutex mutex;
+		std::condition_variable cv;
+
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads && !jobs.empty(); t++) {
+			workers.emplace_back([&, deflate]() {
+				std::vector<char> in, out;
+				for (;;) {
+					size_t j;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						cv.wait(lock, [&]() { return stop || next == jobs.size() || (next < added + window && (ready < max_ready || next == added)); });//next == added: the archive waits on it
+						if (stop || next == jobs.size())
+							return;
+						j = next++;
+					}
+
+					(void)_zipfs_file_pull_prepare(jobs[j], deflate, in, out);
+
+					std::lock_guard<std::mutex> lock(mutex);
+					jobs[j].ready = true;
+					ready += jobs[j].data.size();
+					cv.notify_all();
+				}
+			});
+		}
+
+		//.>entries are added in order, by regions: file data is written to a spill region as it is ready, then released; once
+		//.>past region_min bytes (and at the end) the region is mapped once and its entries are added, directories included.
+		//.>the heap only holds the files in flight
+		bool ok = true;
+		std::shared_ptr<zipfs_spill_file_t> spill_file;
+		const zip_uint64_t region_min = 1 << 20;
+		zip_uint64_t region = 0, region_size = 0;
+		std::vector<const zipfs_query_result_t*> pending;//.>in the current region, not added yet
+		size_t pending_job = 0;
+		auto add_pending = [&]() {
+			zipfs_buffer_t data;
+			zipfs_buffer_t::segment_t segment;
+			if (region_size != 0) {
+				if (!spill_file->map(region, region_size, segment)) {
+					_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE, pending.front()->zipfs_path, "");
+					return false;
+				}
+				data.append(segment);
+			}
+
+			zip_uint64_t offset = 0;
+			for (const zipfs_query_result_t* qr : pending) {
+				if (qr->query_result == QUERY_RESULT::DIR_ADD) {
+					zipfs_internal_assert(!qr->zipfs_path.is_dir());//<-paths are taken from the filesystem (unix fail here?)
+					zipfs_path_t dir = qr->zipfs_path.to_dir();
+					if (!dir_add(dir) || !_zipfs_set_dir_mtime(dir, qr->fs_path_cmp.last_write_time()))
+						return false;
+					continue;
+				}
+
+				const pull_job_t& job = jobs[pending_job++];
+				if (!_zipfs_file_pull_prepared(job, deflate, data.slice(offset, job.spill_size)))
+					return false;
+				offset += job.spill_size;
+			}
+			pending.clear();
+			region_size = 0;
+			return true;
+		};
+
+		size_t j = 0;
+		for (const auto& qr : query_results.m_query_results) {
+			switch (qr.query_result) {
+			case QUERY_RESULT::FILE_WRITE:
+			case QUERY_RESULT::FILE_OVERWRITE: {
+				pull_job_t& job = jobs[j++];
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cv.wait(lock, [&]() { return job.ready; });
+				}
+				zip_uint64_t data_size = job.data.size();
+				if (job.ze.is_error()) {//.>the entries before it are still added
+					if (add_pending())
+						m_ze = job.ze;
+					ok = false;
+				}
+				else if (job.blocks) {
+					ok = add_pending() && _zipfs_file_pull(qr.zipfs_path, qr.fs_path_cmp, qr.query_result);
+				}
+				else if (!job.data.empty() && ((spill_file == nullptr && (spill_file = zipfs_spill_file_t::create()) == nullptr) ||
+					!spill_file->write((region = region_size == 0 ? spill_file->region() : region) + region_size, job.data.data(), job.data.size()))) {
+					if (add_pending())
+						_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE, qr.zipfs_path, "");
+					ok = false;
+				}
+				else {
+					job.spill_size = data_size;
+					region_size += data_size;
+					pending.push_back(&qr);
+					ok = region_size < region_min || add_pending();
+				}
+				std::vector<char>().swap(job.data);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				added++;
+				ready -= data_size;
+				cv.notify_all();
+				break;
+			}
+			case QUERY_RESULT::DIR_ADD: {
+				pending.push_back(&qr);
+				break;
+			}
+			}
+			if (!ok)
+				break;
+		}
+		ok = ok && add_pending();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			cv.notify_all();
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+
+		return ok;
+	}
+
+	bool zipfs_t::_zipfs_file_pull_prepare(pull_job_t& job, bool deflate, std::vector<char>& in, std::vector<char>& out) const {
+		const zipfs_path_t& zipfs_path = job.query_result->zipfs_path;
+		const filesystem_path_t& fs_path = job.query_result->fs_path_cmp;
+
+		bool encrypt_func = _zipfs_encrypt_func();
+		void* state = nullptr;
+		zipfs_deflate_t deflate_;
+		std::vector<char> whole;//.>the encrypt function takes the whole file
+
+		auto fail = [&](const char* zipfs_error, bool fs) {
+			if (state != nullptr)
+				(void)m_file_encrypt_cipher.final(state, out);//.>releases the state
+			job.ze = zipfs_error;
+			if (fs)
+				job.ze.set_fs_path(fs_path);
+			else
+				job.ze.set_zipfs_path(zipfs_path);
+			job.data = {};
+			return false;
+		};
+		auto emit = [&](const char* data, size_t byte_sz) {
+			if (deflate)
+				return deflate_.update(data, byte_sz, job.data);
+			job.data.insert(job.data.end(), data, data + byte_sz);
+			return true;
+		};
+
+		if ((job.blocks = _zipfs_block_deflate_file(fs_path)))
+			return true;
+
+		job.mtime = fs_path.last_write_time();
+		std::ifstream ifs(fs_path.platform_path(), std::ios::binary);
+		if (!ifs)
+			return fail(ZIPFS_ERRSTR_CANNOT_READ_INPUT_FILE, true);
+		else if (deflate && !deflate_.init(zipfs_deflate_t::level(m_compression_flags)))
+			return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+		else if (_zipfs_encrypt_cipher() && (state = m_file_encrypt_cipher.init(m_file_encrypt_cipher.context, zipfs_path.c_str())) == nullptr)
+			return fail(ZIPFS_ERRSTR_CIPHER_ERROR, false);
+
+		in.resize(1 << 16);
+		for (bool eof = false; !eof;) {
+			ifs.read(in.data(), static_cast<std::streamsize>(in.size()));
+			size_t read = static_cast<size_t>(ifs.gcount());
+			eof = ifs.eof();
+			if (ifs.bad() || (!eof && ifs.fail()))
+				return fail(ZIPFS_ERRSTR_CANNOT_READ_INPUT_FILE, true);
+
+			if (encrypt_func) {
+				whole.insert(whole.end(), in.data(), in.data() + read);
+			}
+			else if (state != nullptr) {
+				out.clear();
+				if (!m_file_encrypt_cipher.update(state, reinterpret_cast<const uint8_t*>(in.data()), read, out))
+					return fail(ZIPFS_ERRSTR_CIPHER_ERROR, false);
+				else if (!emit(out.data(), out.size()))
+					return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+			}
+			else if (!emit(in.data(), read)) {
+				return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+			}
+		}
+
+		if (state != nullptr) {
+			out.clear();
+			bool finalized = m_file_encrypt_cipher.final(state, out);//.>releases the state
+			state = nullptr;
+			if (!finalized)
+				return fail(ZIPFS_ERRSTR_CIPHER_ERROR, false);
+			else if (!emit(out.data(), out.size()))
+				return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+		}
+		else if (encrypt_func) {
+			uint8_t* ret_buf = nullptr;
+			size_t ret_len;
+			m_file_encrypt_func(zipfs_path.c_str(), reinterpret_cast<const uint8_t*>(whole.data()), whole.size(), &ret_buf, &ret_len);
+			bool emitted = emit(reinterpret_cast<const char*>(ret_buf), ret_len);
+			delete[] ret_buf;
+			if (!emitted)
+				return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+		}
+
+		if (deflate && !deflate_.finish(job.data))
+			return fail(ZIPFS_ERRSTR_CANNOT_COMPRESS, false);
+
+		job.size = deflate ? deflate_.size() : job.data.size();
+		job.crc = deflate_.crc();
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_file_pull_prepared(const pull_job_t& job, bool deflate, const zipfs_buffer_t& data) {
+		const zipfs_path_t& zipfs_path = job.query_result->zipfs_path;
+		QUERY_RESULT qr = job.query_result->query_result;
+
+		if ((qr == QUERY_RESULT::FILE_WRITE && !dir_add(zipfs_path.parent_path())) || !_zipfs_open(ZIPFS_ZIP_FLAGS_NONE)) {
+			return false;
+		}
+		zip_int64_t index_ = _zipfs_name_locate(zipfs_path);
+
+		zip_source_t* src;
+		if (deflate) {
+			src = zipfs_deflated_source_t::create(data, ZIP_CM_DEFLATE, job.size, job.crc, job.mtime, zip_get_error(m_zip_t));
+		}
+		else {
+			zipfs_buffer_source_t* data_buffer;
+			src = zipfs_buffer_source_t::create(data, &data_buffer, zip_get_error(m_zip_t));
+		}
+
+		if (src == nullptr) {
+			_zipfs_zip_get_error_and_close(zipfs_path, "");
+			return false;
+		}
+
+		bool from_source = qr == QUERY_RESULT::FILE_WRITE ?
+			_zipfs_file_add_or_pull_from_source(zipfs_path, src, index_) :
+			_zipfs_file_add_replace_or_pull_replace_from_source(zipfs_path, index_, src);
+		if (!from_source) {//.>reverted
+			_zipfs_zip_get_error_and_close(zipfs_path, "");
+			return false;
+		}
+		else if (zip_file_set_mtime(m_zip_t, index_, job.mtime, ZIPFS_ZIP_FLAGS_NONE) == -1) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			if (qr == QUERY_RESULT::FILE_WRITE)
+				_zipfs_entry_add_revert(zipfs_path, index_);
+			_zipfs_close();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_dir_extract_parallel(const zipfs_query_results_t& query_results) {
+		//.>directories first: files are then written into existing directories
+		std::vector<const zipfs_query_result_t*> files;
+		for (const auto& qr : query_results.m_query_results) {
+			switch (qr.query_result) {
+			case QUERY_RESULT::DIR_ADD: {
+				if (!std::filesystem::create_directory(qr.fs_path.platform_path()))//assumes ls() doesn't list a nested directory before its parent
+					return false;
+				break;
+			}
+			case QUERY_RESULT::FILE_WRITE:
+			case QUERY_RESULT::FILE_OVERWRITE: {
+				files.push_back(&qr);
+				break;
+			}
+			}
+		}
+		if (files.empty())
+			return true;
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return false;
+
+		std::vector<zip_int64_t> indexes(files.size());
+		for (size_t f = 0; f < files.size(); f++) {
+			if ((indexes[f] = _zipfs_name_locate(files[f]->zipfs_path_cmp)) == -1) {
+				_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_CANNOT_LOCATE_NAME, files[f]->zipfs_path_cmp, "");
+				return false;
+			}
+		}
+
+		//.>one read-only archive per worker over the same immutable source data
+		size_t threads = std::min<size_t>(m_extract_threads, files.size());
+		std::vector<zip_t*> zips;
+		for (size_t t = 0; t < threads; t++) {
+			zip_t* zip = _zipfs_snapshot_open();
+			if (zip == nullptr) {
+				for (zip_t* zip_ : zips)
+					zip_discard(zip_);
+				_zipfs_close();
+				return false;
+			}
+			zips.push_back(zip);
+		}
+		if (!_zipfs_no_error_and_close()) {
+			for (zip_t* zip : zips)
+				zip_discard(zip);
+			return false;
+		}
+
+		std::atomic<size_t> next{ 0 };
+		std::atomic<bool> failed{ false };
+		std::mutex ze_mutex;
+		zipfs_error_t ze = zipfs_error_t::no_error();//.>first error
+
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; t++) {
+			workers.emplace_back([&, t]() {
+				std::vector<char> in, out;
+				zipfs_error_t ze_ = zipfs_error_t::no_error();
+				for (size_t f; !failed && (f = next++) < files.size();) {
+					if (!_zipfs_file_extract_worker(zips[t], indexes[f], *files[f], in, out, ze_)) {
+						std::lock_guard<std::mutex> lock(ze_mutex);
+						if (!failed.exchange(true))
+							ze = ze_;
+					}
+				}
+			});
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+		for (zip_t* zip : zips)
+			zip_discard(zip);//.>read-only
+
+		m_ze = ze;
+		return !failed;
+	}
+
+	bool zipfs_t::_zipfs_file_extract_worker(zip_t* zip, zip_int64_t index, const zipfs_query_result_t& query_result, std::vector<char>& in, std::vector<char>& out, zipfs_error_t& ze) const {
+		const filesystem_path_t& fs_path = query_result.fs_path;
+		if (query_result.query_result == QUERY_RESULT::FILE_WRITE && !fs_path.parent_path().exists()) {
+			std::error_code ec;
+			if (!std::filesystem::create_directories(fs_path.parent_path().platform_path(), ec) && !fs_path.parent_path().exists()) {//.>another worker may have created it
+				ze = "could not create parent directory.";
+				ze.set_fs_path(fs_path.parent_path());
+				return false;
+			}
+		}
+
+		std::ios::openmode open_mode = std::ios::binary | std::ios::out;
+		if (query_result.query_result == QUERY_RESULT::FILE_OVERWRITE) open_mode |= std::ios::trunc;
+
+		bool decrypt_func = _zipfs_decrypt_func();
+		std::vector<char> data;//.>the decrypt function takes the whole file
+		std::ofstream ofs(fs_path.platform_path(), open_mode);
+		if (!ofs || !_zipfs_zip_file_chunks(zip, index, false, query_result.zipfs_path_cmp, _zipfs_decrypt_cipher() ? &m_file_decrypt_cipher : nullptr, in, out, [&](const char* data_, size_t byte_sz) {
+			if (decrypt_func)
+				data.insert(data.end(), data_, data_ + byte_sz);
+			else
+				ofs.write(data_, static_cast<std::streamsize>(byte_sz));
+			return static_cast<bool>(ofs);
+		}, ze)) {
+			if (!ze.is_error()) {//.>write failed rather than read
+				ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+				ze.set_fs_path(fs_path);
+			}
+			return false;
+		}
+
+		if (decrypt_func) {
+			uint8_t* ret_buf = nullptr;
+			size_t ret_len;
+			m_file_decrypt_func(query_result.zipfs_path_cmp.c_str(), reinterpret_cast<uint8_t*>(data.data()), data.size(), &ret_buf, &ret_len);
+			ofs.write(reinterpret_cast<const char*>(ret_buf), static_cast<std::streamsize>(ret_len));
+			delete[] ret_buf;
+		}
+		if (!ofs.flush()) {
+			ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+			ze.set_fs_path(fs_path);
+			return false;
+		}
+		ofs.close();
+
+		zip_stat_t stat_;
+		if (zip_stat_index(zip, index, ZIPFS_ZIP_FLAGS_NONE, &stat_) == -1) {
+			ze = zip_get_error(zip);
+			ze.set_zipfs_path(query_result.zipfs_path_cmp);
+			return false;
+		}
+		else if (!fs_path.last_write_time(zipfs_zip_stat_t(stat_).mtime)) {//mtime
+			zipfs_debug_assert(false);
+		}
+
+		return true;
+	}
+
 	bool zipfs_t::_zipfs_file_pull(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, QUERY_RESULT qr) {
 		switch (qr) {
 		case QUERY_RESULT::FILE_WRITE:
@@ -229,17 +687,26 @@ namespace zipfs {
 			zip_int64_t index_ = _zipfs_name_locate(zipfs_path);
 
 			zip_source_t* src;
-			bool from_buffer = m_file_encrypt && m_file_encrypt_func != nullptr;
+			bool from_buffer = _zipfs_encrypt_func();
+			bool from_blocks = _zipfs_block_deflate_file(fs_path);
 
-			if (from_buffer) {
-				_zipfs_source_buffer_encrypt(zipfs_path, fs_path.cat(), &src);
+			if (from_blocks) {
+				if (!_zipfs_source_block_deflate(zipfs_path, fs_path, &src)) {
+					_zipfs_close();
+					return false;
+				}
+			}
+			else if (from_buffer) {
+				std::vector<char> buffer = fs_path.cat();
+				_zipfs_source_buffer_encrypt(zipfs_path, buffer.data(), buffer.size(), &src);
 			}
 			else {
 				src = zip_source_file(m_zip_t, fs_path.u8path().c_str(), 0, -1);//takes care of mtime
+				if (src != nullptr && _zipfs_encrypt_cipher())//.>encrypted as libzip reads the file
+					src = zipfs_cipher_source_t::create(src, m_file_encrypt_cipher, zipfs_path.c_str(), &m_cipher_failed, zip_get_error(m_zip_t));
 			}
 
 			if (src == nullptr) {
-				_zipfs_unchange_all();
 				_zipfs_zip_get_error_and_close("/", fs_path);
 				return false;
 			}
@@ -251,28 +718,31 @@ namespace zipfs {
 				break;
 			}
 			case QUERY_RESULT::FILE_OVERWRITE: {
-				from_source = _zipfs_file_add_replace_or_pull_replace_from_source(index_, src);
+				from_source = _zipfs_file_add_replace_or_pull_replace_from_source(zipfs_path, index_, src);
 				break;
 			}
 			}
-			if (!from_source) {
-				_zipfs_unchange_all();
+			if (!from_source) {//.>reverted
 				_zipfs_zip_get_error_and_close(zipfs_path, "");
 				return false;
 			}
 
 			/*
-				set mtime if zip_source_buffer was used
+				set mtime if zip_source_buffer, the cipher source or the block deflate source was used
 			*/
-			if (from_buffer) {
+			if (from_buffer || from_blocks || _zipfs_encrypt_cipher()) {
 				time_t fs_mtime = fs_path.last_write_time();
 				if (zip_file_set_mtime(m_zip_t, index_, fs_mtime, ZIPFS_ZIP_FLAGS_NONE) == -1) {
-					_zipfs_zip_get_error_and_close(zipfs_path, "");
+					_zipfs_zip_get_error(zipfs_path, "");
+					if (qr == QUERY_RESULT::FILE_WRITE)
+						_zipfs_entry_add_revert(zipfs_path, index_);
+					_zipfs_close();
 					return false;
 				}
 			}
 
-			_zipfs_no_error_and_close();
+			if (!_zipfs_no_error_and_close())
+				return false;
 			break;
 		}
 		case QUERY_RESULT::FILE_ORPHAN_KEEP:
@@ -290,6 +760,123 @@ namespace zipfs {
 		return true;
 	}
 
+	bool zipfs_t::_zipfs_block_deflate_file(const filesystem_path_t& fs_path) const {
+		return !_zipfs_encrypt_func() && m_block_deflate_threads > 1 && (m_compression == ZIP_CM_DEFLATE || m_compression == ZIP_CM_DEFAULT) &&
+			fs_path.file_size() >= m_block_deflate_min_size;
+	}
+
+	bool zipfs_t::_zipfs_source_block_deflate(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, zip_source_t** src) {
+		//.>compressed to a temporary file, mapped back: memory stays bounded by the blocks in flight
+		std::shared_ptr<zipfs_spill_file_t> spill_file = zipfs_spill_file_t::create();
+		if (spill_file == nullptr) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE, zipfs_path, "");
+			return false;
+		}
+		zip_uint64_t offset = spill_file->region(), comp_size = 0;
+		bool spilled = true;
+		zipfs_block_deflate_t block_deflate(zipfs_deflate_t::level(m_compression_flags), m_block_deflate_threads, 1 << 20, [&](const char* data, size_t byte_sz) {
+			spilled = spill_file->write(offset + comp_size, data, byte_sz);
+			comp_size += byte_sz;
+			return spilled;
+		});
+
+		time_t mtime = fs_path.last_write_time();
+		std::ifstream ifs(fs_path.platform_path(), std::ios::binary);
+		if (!ifs) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_READ_INPUT_FILE, "/", fs_path);
+			return false;
+		}
+
+		//.>the encrypt cipher runs as the file is read, ahead of the blocks
+		void* state = nullptr;
+		if (_zipfs_encrypt_cipher() && (state = m_file_encrypt_cipher.init(m_file_encrypt_cipher.context, zipfs_path.c_str())) == nullptr) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CIPHER_ERROR, zipfs_path, "");
+			return false;
+		}
+
+		const char* error = nullptr;
+		bool read_error = false;
+		std::vector<char> in(1 << 20), out;//.>local: the object's cat buffers would keep 1 MiB after the pull
+		for (bool eof = false; !eof && error == nullptr;) {
+			ifs.read(in.data(), static_cast<std::streamsize>(in.size()));
+			size_t read = static_cast<size_t>(ifs.gcount());
+			eof = ifs.eof();
+			if (ifs.bad() || (!eof && ifs.fail())) {
+				error = ZIPFS_ERRSTR_CANNOT_READ_INPUT_FILE;
+				read_error = true;
+			}
+			else if (state != nullptr) {
+				out.clear();
+				if (!m_file_encrypt_cipher.update(state, reinterpret_cast<const uint8_t*>(in.data()), read, out))
+					error = ZIPFS_ERRSTR_CIPHER_ERROR;
+				else if (!block_deflate.update(out.data(), out.size()))
+					error = spilled ? ZIPFS_ERRSTR_CANNOT_COMPRESS : ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+			}
+			else if (!block_deflate.update(in.data(), read)) {
+				error = spilled ? ZIPFS_ERRSTR_CANNOT_COMPRESS : ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+			}
+		}
+
+		if (state != nullptr) {
+			out.clear();
+			if (!m_file_encrypt_cipher.final(state, out))//.>releases the state
+				error = error != nullptr ? error : ZIPFS_ERRSTR_CIPHER_ERROR;
+			else if (error == nullptr && !block_deflate.update(out.data(), out.size()))
+				error = spilled ? ZIPFS_ERRSTR_CANNOT_COMPRESS : ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+		}
+		if (error == nullptr && !block_deflate.finish())
+			error = spilled ? ZIPFS_ERRSTR_CANNOT_COMPRESS : ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+
+		if (error != nullptr) {
+			if (read_error)
+				_zipfs_zipfs_set_error(error, "/", fs_path);
+			else
+				_zipfs_zipfs_set_error(error, zipfs_path, "");
+			return false;
+		}
+
+		zipfs_buffer_t::segment_t segment;
+		if (!spill_file->map(offset, comp_size, segment)) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_MAP_FILE, zipfs_path, "");
+			return false;
+		}
+		zipfs_buffer_t data;
+		data.append(segment);
+
+		if ((*src = zipfs_deflated_source_t::create(data, ZIP_CM_DEFLATE, block_deflate.size(), block_deflate.crc(), mtime, zip_get_error(m_zip_t))) == nullptr) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_file_extract_chunks(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, std::ios::openmode open_mode) {
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return false;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, false, index, size)) {
+			_zipfs_close();
+			return false;
+		}
+
+		std::ofstream ofs(fs_path.platform_path(), open_mode | std::ios::out);
+		if (!ofs || !_zipfs_cat_chunks(zipfs_path, index, false, [&ofs](const char* data, size_t byte_sz) {
+			return static_cast<bool>(ofs.write(data, static_cast<std::streamsize>(byte_sz)));
+		}) || !ofs.flush()) {
+			if (!m_ze.is_error()) {//.>write failed rather than read
+				m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+				m_ze.set_fs_path(fs_path);
+			}
+			_zipfs_close();
+			return false;
+		}
+
+		return _zipfs_no_error_and_close();
+	}
+
 	bool zipfs_t::_zipfs_file_extract(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, QUERY_RESULT qr) {
 		switch (qr) {
 		case QUERY_RESULT::FILE_WRITE:
@@ -304,16 +891,22 @@ namespace zipfs {
 			if (qr == QUERY_RESULT::FILE_OVERWRITE) open_mode |= std::ios::trunc;
 
 			zipfs_zip_stat_t stat_;
-			std::vector<char> buf;
-			if (!cat(zipfs_path, buf)) {
-				return false;
+			if (_zipfs_decrypt_func()) {//.>the decrypt function takes the whole file
+				std::vector<char> buf;
+				if (!cat(zipfs_path, buf)) {
+					return false;
+				}
+				else if (!fs_path.cat(buf, open_mode)) {//write
+					m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+					m_ze.set_fs_path(fs_path);
+					return false;
+				}
 			}
-			else if (!stat(zipfs_path, stat_)) {
+			else if (!_zipfs_file_extract_chunks(zipfs_path, fs_path, open_mode)) {//.>streamed chunk by chunk
 				return false;
 			}
-			else if (!fs_path.cat(buf, open_mode)) {//write
-				m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
-				m_ze.set_fs_path(fs_path);
+
+			if (!stat(zipfs_path, stat_)) {
 				return false;
 			}
 			else if (!fs_path.last_write_time(stat_.mtime)) {//mtime
@@ -343,17 +936,30 @@ namespace zipfs {
 	}
 
 	zipfs_error_t zipfs_t::dir_pull(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, OVERWRITE overwrite, ORPHAN orphan) {
-		if (!
-			_zipfs_image_internal_update())//make source backup
+		/*
+			dir_pull is a transaction: it runs in its own session (unless one is active)
+			and pending changes are dropped on error - no source backup needed.
+			in the caller's session the error is only returned: its changes aren't ours to drop.
+		*/
+		bool session = !m_session;
+		if (session && !
+			session_begin())
 			return m_ze;
 
 		if (!
 			_zipfs_dir_pull(zipfs_path, fs_path, nullptr, overwrite, orphan, false)) {
 
-			_zipfs_revert_to_image_internal();//restore image
+			if (session) {
+				zipfs_error_t ze = m_ze;
+				(void)session_discard();
+				m_ze = ze;
+			}
 			return m_ze;
 		}
 
+		if (session)
+			return session_commit();
+
 		zipfs_internal_assert(!m_ze.is_error());
 		return m_ze;
 	}
@@ -376,6 +982,19 @@ namespace zipfs {
 		return m_ze;
 	}
 
+	void zipfs_t::set_extract_threads(unsigned int threads) {
+		m_extract_threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	void zipfs_t::set_pull_threads(unsigned int threads) {
+		m_pull_threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	void zipfs_t::set_block_deflate(unsigned int threads, zip_uint64_t min_file_sz) {
+		m_block_deflate_threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+		m_block_deflate_min_size = min_file_sz;
+	}
+
 	zipfs_error_t zipfs_t::dir_extract(const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path, OVERWRITE overwrite) {
 		if (!//should be try/catch
 			_zipfs_dir_extract(zipfs_path, fs_path, nullptr, overwrite, false))
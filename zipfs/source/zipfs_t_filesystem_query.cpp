@@ -7,7 +7,7 @@ namespace zipfs {
 
 	//pull
 	QUERY_RESULT zipfs_t::_zipfs_get_query_result(OVERWRITE overwrite, ORPHAN orphan, const zipfs_path_t& zipfs_path, const filesystem_path_t& fs_path) {
-		zipfs_internal_assert(m_zip_t == nullptr);
+		zipfs_internal_assert(m_zip_t == nullptr || m_session);
 
 		//fs_path is directory
 		if (fs_path.is_directory()) {
@@ -125,7 +125,7 @@ namespace zipfs {
 
 	//extract
 	QUERY_RESULT zipfs_t::_zipfs_get_query_result(OVERWRITE overwrite, const filesystem_path_t& fs_path, const zipfs_path_t& zipfs_path) {
-		zipfs_internal_assert(m_zip_t == nullptr);
+		zipfs_internal_assert(m_zip_t == nullptr || m_session);
 		
 		//zipfs_path is directory
 		if (zipfs_path.is_dir()) {
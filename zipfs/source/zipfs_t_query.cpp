@@ -4,7 +4,7 @@
 namespace zipfs {
 
 	QUERY_RESULT zipfs_t::_zipfs_get_query_result(OVERWRITE overwrite, const zipfs_path_t& zipfs_path) {
-		zipfs_internal_assert(m_zip_t == nullptr);
+		zipfs_internal_assert(m_zip_t == nullptr || m_session);
 		zipfs_internal_assert(zipfs_path.is_file());
 
 		zip_int64_t index_;
@@ -0,0 +1,248 @@
+#include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_error_strings.h>
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <zipfs/zipfs_inflate_index_t.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace zipfs {
+
+	zipfs_error_t zipfs_t::read_range(const zipfs_path_t& zipfs_path, zip_uint64_t offset, zip_uint64_t byte_sz, std::vector<char>& result) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, false, index, size)) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		if (_zipfs_decrypt_cipher()) {//.>no random access into the cipher: decrypted from the start, up to the end of the range
+			zip_uint64_t position = 0, last = offset + std::min(byte_sz, ~zip_uint64_t(0) - offset);
+			result.clear();
+			if (!_zipfs_cat_chunks(zipfs_path, index, false, [offset, last, &position, &result](const char* data, size_t data_sz) {
+				zip_uint64_t begin = std::max(offset, position), end = std::min(last, position + data_sz);
+				if (begin < end)
+					result.insert(result.end(), data + (begin - position), data + (end - position));
+				position += data_sz;
+				return position < last;
+			})) {
+				_zipfs_close();
+				return m_ze;
+			}
+
+			_zipfs_no_error_and_close();
+			return m_ze;
+		}
+		else if (_zipfs_decrypt_func()) {//.>the decrypt function takes the whole file
+			std::vector<char> data;
+			if (!_zipfs_cat(zipfs_path, data, false)) {
+				_zipfs_close();
+				return m_ze;
+			}
+
+			offset = std::min<zip_uint64_t>(offset, data.size());
+			byte_sz = std::min<zip_uint64_t>(byte_sz, data.size() - offset);
+			result.assign(data.begin() + offset, data.begin() + offset + byte_sz);
+
+			_zipfs_no_error_and_close();
+			return m_ze;
+		}
+
+		offset = std::min(offset, size);
+		byte_sz = std::min(byte_sz, size - offset);
+		result.resize(byte_sz);
+		if (!_zipfs_read_range(zipfs_path, index, offset, result.data(), byte_sz)) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::range_index_save(const zipfs_path_t& zipfs_path, std::vector<char>& result) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		zipfs_inflate_index_t* inflate_index;
+		if (!_zipfs_cat_size(zipfs_path, false, index, size) || !_zipfs_range_index(zipfs_path, index, inflate_index)) {
+			_zipfs_close();
+			return m_ze;
+		}
+		else if (inflate_index == nullptr) {
+			_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_FILE_NOT_DEFLATED, zipfs_path, "");
+			return m_ze;
+		}
+
+		inflate_index->save(result);
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::range_index_load(const zipfs_path_t& zipfs_path, const std::vector<char>& data) {
+		zipfs_usage_assert(zipfs_path.is_file(), ZIPFS_ERRSTR_FILE_PATH_EXPECTED);
+
+		if (!
+			_zipfs_open(ZIP_RDONLY))
+			return m_ze;
+
+		zip_int64_t index;
+		zip_uint64_t size;
+		if (!_zipfs_cat_size(zipfs_path, false, index, size)) {
+			_zipfs_close();
+			return m_ze;
+		}
+
+		zip_stat_t stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+			_zipfs_zip_get_error_and_close(zipfs_path, "");
+			return m_ze;
+		}
+
+		std::unique_ptr<zipfs_inflate_index_t> inflate_index{ new zipfs_inflate_index_t() };
+		if (!inflate_index->load(data) || !inflate_index->matches(stat.size, stat.comp_size, stat.crc)) {
+			_zipfs_zipfs_set_error_and_close(ZIPFS_ERRSTR_RANGE_INDEX_MISMATCH, zipfs_path, "");
+			return m_ze;
+		}
+		m_inflate_indexes[zipfs_path] = std::move(inflate_index);
+
+		_zipfs_no_error_and_close();
+		return m_ze;
+	}
+
+	void zipfs_t::set_range_index_span(zip_uint64_t byte_sz) {
+		m_range_index_span = byte_sz;
+	}
+
+	bool zipfs_t::_zipfs_range_index(const zipfs_path_t& zipfs_path, zip_int64_t index, zipfs_inflate_index_t*& result) {//result: nullptr if the file isn't deflated
+		zipfs_internal_assert(m_zip_t != nullptr);
+		result = nullptr;
+
+		zip_stat_t stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+		else if ((stat.valid & (ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC)) != (ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC))
+			return true;
+		else if (stat.comp_method != ZIP_CM_DEFLATE || stat.encryption_method != ZIP_EM_NONE)
+			return true;
+
+		std::unique_ptr<zipfs_inflate_index_t>& inflate_index_ = m_inflate_indexes[zipfs_path];
+		if (inflate_index_ == nullptr)
+			inflate_index_.reset(new zipfs_inflate_index_t());
+		zipfs_inflate_index_t& inflate_index = *inflate_index_;
+		if (!inflate_index.matches(stat.size, stat.comp_size, stat.crc)) {//.>new, or built for data the file no longer has
+			zip_file_t* file = zip_fopen_index(m_zip_t, index, ZIP_FL_COMPRESSED);
+			if (file == nullptr) {
+				m_inflate_indexes.erase(zipfs_path);
+				_zipfs_zip_get_error(zipfs_path, "");
+				return false;
+			}
+
+			bool built = inflate_index.build(file, m_range_index_span);
+			(void)zip_fclose(file);
+			if (!built) {
+				m_inflate_indexes.erase(zipfs_path);
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_INDEX_FILE, zipfs_path, "");
+				return false;
+			}
+			inflate_index.set_entry(stat.size, stat.comp_size, stat.crc);
+		}
+
+		result = &inflate_index;
+		return true;
+	}
+
+	bool zipfs_t::_zipfs_read_range(const zipfs_path_t& zipfs_path, zip_int64_t index, zip_uint64_t offset, char* buffer, zip_uint64_t byte_sz) {
+		zipfs_internal_assert(m_zip_t != nullptr);
+
+		if (byte_sz == 0)
+			return true;
+
+		zipfs_inflate_index_t* inflate_index;
+		if (!_zipfs_range_index(zipfs_path, index, inflate_index))
+			return false;
+
+		if (inflate_index != nullptr) {//.>inflated from the nearest checkpoint
+			zip_file_t* file = zip_fopen_index(m_zip_t, index, ZIP_FL_COMPRESSED);
+			if (file == nullptr) {
+				_zipfs_zip_get_error(zipfs_path, "");
+				return false;
+			}
+
+			zip_uint64_t read;
+			bool ok = inflate_index->read(file, offset, buffer, byte_sz, read);
+			(void)zip_fclose(file);
+			if (!ok || read != byte_sz) {
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
+				return false;
+			}
+			return true;
+		}
+
+		zip_stat_t stat;
+		zip_stat_init(&stat);
+		if (zip_stat_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE, &stat) == -1) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+
+		zip_file_t* file = zip_fopen_index(m_zip_t, index, ZIPFS_ZIP_FLAGS_NONE);
+		if (file == nullptr) {
+			_zipfs_zip_get_error(zipfs_path, "");
+			return false;
+		}
+
+		bool stored = (stat.valid & ZIP_STAT_COMP_METHOD) && (stat.valid & ZIP_STAT_ENCRYPTION_METHOD) && stat.comp_method == ZIP_CM_STORE && stat.encryption_method == ZIP_EM_NONE;
+		if (stored) {
+			if (zip_fseek(file, static_cast<zip_int64_t>(offset), SEEK_SET) != 0) {
+				zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
+				return false;
+			}
+		}
+		else {//.>other methods, encrypted: read from the start
+			std::vector<char> discard(std::min<zip_uint64_t>(offset, 1 << 16));
+			for (zip_uint64_t skipped = 0; skipped < offset;) {
+				zip_int64_t read = zip_fread(file, discard.data(), std::min<zip_uint64_t>(offset - skipped, discard.size()));
+				if (read <= 0) {
+					zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+					_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
+					return false;
+				}
+				skipped += static_cast<zip_uint64_t>(read);
+			}
+		}
+
+		for (zip_uint64_t read = 0; read < byte_sz;) {
+			zip_int64_t n = zip_fread(file, buffer + read, byte_sz - read);
+			if (n <= 0) {
+				zip_fclose(file);//Upon successful completion 0 is returned. Otherwise, the error code is returned.
+				_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_READ_ALL, zipfs_path, "");
+				return false;
+			}
+			read += static_cast<zip_uint64_t>(n);
+		}
+
+		if (zip_fclose(file) != 0) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_FILE_CANNOT_CLOSE, zipfs_path, "");
+			return false;
+		}
+		return true;
+	}
+}
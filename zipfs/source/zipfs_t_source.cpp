@@ -0,0 +1,223 @@
+#include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_error_strings.h>
+#include <zipfs/zipfs_buffer_source_t.h>
+#include <algorithm>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#endif
+
+namespace zipfs {
+
+	namespace {
+
+		constexpr zip_uint64_t source_chunk_sz = 1 << 20;
+
+		bool fd_write(int fd, const char* data, size_t byte_sz) {
+			while (byte_sz != 0) {
+#ifdef _WIN32
+				int written = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(byte_sz, source_chunk_sz)));
+				if (written <= 0)
+					return false;
+#else
+				ssize_t written = write(fd, data, byte_sz);
+				if (written == -1 && errno == EINTR)
+					continue;
+				else if (written <= 0)
+					return false;
+#endif
+				data += written;
+				byte_sz -= static_cast<size_t>(written);
+			}
+			return true;
+		}
+
+		bool fd_sync(int fd) {
+#ifdef _WIN32
+			return _commit(fd) == 0;
+#else
+			return fsync(fd) == 0;
+#endif
+		}
+
+#ifndef _WIN32
+		int temp_open(const std::string& path, std::string& tmp_path) {//.>0666 under a random name: the kernel applies the umask, as it would to the target
+			std::random_device random;
+			for (int attempt = 0; attempt < 64; attempt++) {
+				char suffix[16];
+				(void)std::snprintf(suffix, sizeof(suffix), ".zipfs-%08x", static_cast<unsigned int>(random()));
+				tmp_path = path + suffix;
+				int fd = open(tmp_path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666);
+				if (fd != -1 || errno != EEXIST)
+					return fd;
+			}
+			return -1;
+		}
+#endif
+	}
+
+	zipfs_error_t zipfs_t::save(const filesystem_path_t& fs_path) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		//.>temporary file next to the target: same filesystem, so the rename is atomic
+#ifdef _WIN32
+		std::wstring tmp_path = fs_path.platform_path().wstring() + L".zipfs-XXXXXX";
+		int fd = _wmktemp_s(tmp_path.data(), tmp_path.size() + 1) == 0 ?
+			_wopen(tmp_path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE) : -1;
+#else
+		std::string tmp_path;
+		int fd = temp_open(fs_path.platform_path().string(), tmp_path);
+		struct stat st;
+		if (fd != -1 && ::stat(fs_path.platform_path().c_str(), &st) == 0)//.>an existing target keeps its mode
+			(void)fchmod(fd, st.st_mode & 07777);
+#endif
+		if (fd == -1) {
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_CREATE_TEMP_FILE, "/", fs_path);
+			return m_ze;
+		}
+
+		bool written = write_source(fd, true);//.>data durable before it becomes visible
+#ifdef _WIN32
+		written = _close(fd) == 0 && written;
+		bool replaced = written && MoveFileExW(tmp_path.c_str(), fs_path.platform_path().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+		if (!replaced)
+			(void)_wunlink(tmp_path.c_str());
+#else
+		written = close(fd) == 0 && written;
+		bool replaced = written && rename(tmp_path.c_str(), fs_path.platform_path().c_str()) == 0;
+		if (!replaced)
+			(void)unlink(tmp_path.c_str());
+#endif
+		if (!replaced) {//.>the target is left untouched
+			if (written)
+				m_ze = ZIPFS_ERRSTR_CANNOT_REPLACE_FILE;
+			else if (!m_ze.is_error())
+				m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+			m_ze.set_fs_path(fs_path);
+			return m_ze;
+		}
+
+#ifndef _WIN32
+		//.>the rename itself durable (MOVEFILE_WRITE_THROUGH on Windows)
+		int dir_fd = open(fs_path.parent_path().platform_path().empty() ? "." : fs_path.parent_path().platform_path().c_str(), O_RDONLY | O_DIRECTORY);
+		if (dir_fd == -1 || fsync(dir_fd) != 0) {
+			if (dir_fd != -1)
+				(void)close(dir_fd);
+			_zipfs_zipfs_set_error(ZIPFS_ERRSTR_CANNOT_SYNC_DIRECTORY, "/", fs_path.parent_path());
+			return m_ze;
+		}
+		(void)close(dir_fd);
+#endif
+
+		m_ze = zipfs_error_t::no_error();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::source_size(zip_uint64_t& result) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		result = 0;
+		if (!_zipfs_file_backed()) {
+			result = m_zipfs_buffer_source_t->buffer().size();
+
+			m_ze = zipfs_error_t::no_error();
+			return m_ze;
+		}
+
+		zip_stat_t stat;
+		if (zip_source_stat(m_zip_source_t, &stat) == -1) {
+			if (zip_error_code_zip(zip_source_error(m_zip_source_t)) == ZIP_ER_NOENT) {//.>file doesn't exist (yet)
+				m_ze = zipfs_error_t::no_error();
+				return m_ze;
+			}
+			_zipfs_zip_source_error();
+			return m_ze;
+		}
+		else if (!(stat.valid & ZIP_STAT_SIZE)) {
+			m_ze = ZIPFS_ERRSTR_SOURCE_STAT_SIZE_NOT_VALID;
+			return m_ze;
+		}
+
+		result = stat.size;
+		m_ze = zipfs_error_t::no_error();
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::write_source(int fd, bool sync) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		if (!_zipfs_source_chunks([fd](const char* data, size_t byte_sz) { return fd_write(fd, data, byte_sz); }) ||
+			(sync && !fd_sync(fd))) {
+			if (!m_ze.is_error())//.>write failed rather than read
+				m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+		}
+
+		return m_ze;
+	}
+
+	zipfs_error_t zipfs_t::write_source(std::ostream& os) {
+		zipfs_usage_assert(!m_session, ZIPFS_ERRSTR_SESSION_ACTIVE);
+
+		if (!_zipfs_source_chunks([&os](const char* data, size_t byte_sz) { return static_cast<bool>(os.write(data, static_cast<std::streamsize>(byte_sz))); }) ||
+			!os.flush()) {
+			if (!m_ze.is_error())//.>write failed rather than read
+				m_ze = ZIPFS_ERRSTR_ERROR_WRITING_TO_OUTPUT_FILE;
+		}
+
+		return m_ze;
+	}
+
+	bool zipfs_t::_zipfs_source_chunks(const std::function<bool(const char* data, size_t byte_sz)>& sink) {
+		m_ze = zipfs_error_t::no_error();
+
+		if (!_zipfs_file_backed()) {//.>the segments directly, no zip_source_t round trip
+			zipfs_buffer_t buffer = m_zipfs_buffer_source_t->buffer();//.>pins the segments
+			for (const zipfs_buffer_t::segment_t& segment : buffer.segments())
+				for (zip_uint64_t offset = 0; offset < segment.size; offset += source_chunk_sz)
+					if (!sink(segment.data.get() + offset, static_cast<size_t>(std::min(source_chunk_sz, segment.size - offset))))
+						return false;
+			return true;
+		}
+
+		zip_uint64_t size;
+		if (!source_size(size))
+			return false;
+		else if (size == 0)
+			return true;
+
+		if (zip_source_open(m_zip_source_t) == -1) {
+			_zipfs_zip_source_error();
+			return false;
+		}
+
+		std::vector<char> chunk(static_cast<size_t>(std::min(source_chunk_sz, size)));
+		for (zip_uint64_t offset = 0; offset < size;) {
+			zip_int64_t read = zip_source_read(m_zip_source_t, chunk.data(), std::min<zip_uint64_t>(chunk.size(), size - offset));
+			if (read <= 0) {
+				_zipfs_zip_source_error_and_source_close();
+				return false;
+			}
+			else if (!sink(chunk.data(), static_cast<size_t>(read))) {
+				(void)zip_source_close(m_zip_source_t);
+				return false;
+			}
+			offset += static_cast<zip_uint64_t>(read);
+		}
+
+		int close = zip_source_close(m_zip_source_t);
+		zipfs_internal_assert(close != -1);
+		return true;
+	}
+}
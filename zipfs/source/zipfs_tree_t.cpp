@@ -0,0 +1,111 @@
+#include <zipfs/zipfs_tree_t.h>
+#include <zipfs/zipfs_assert.h>
+
+namespace zipfs {
+
+	zipfs_tree_t::zipfs_tree_t() {
+		clear();
+	}
+
+	void zipfs_tree_t::insert(const zipfs_path_t& zipfs_path) {
+		size_t node = 0;
+		for (const std::string& c : components(zipfs_path)) {
+			auto find = m_nodes[node].children.find(c);
+			if (find != m_nodes[node].children.end()) {
+				node = find->second;
+			}
+			else {
+				size_t child = node_new();//.>might reallocate m_nodes
+				m_nodes[node].children.insert({ c, child });
+				node = child;
+			}
+		}
+
+		m_nodes[node].entry = true;
+	}
+
+	bool zipfs_tree_t::erase(const zipfs_path_t& zipfs_path) {
+		std::vector<std::string> components_ = components(zipfs_path);
+		std::vector<size_t> nodes = { 0 };
+		for (const std::string& c : components_) {
+			auto find = m_nodes[nodes.back()].children.find(c);
+			if (find == m_nodes[nodes.back()].children.end())
+				return false;
+			nodes.push_back(find->second);
+		}
+
+		if (nodes.size() == 1 || !m_nodes[nodes.back()].entry)
+			return false;
+		m_nodes[nodes.back()].entry = false;
+
+		//prune nodes that aren't entries and have no children anymore (root is kept)
+		for (size_t n = nodes.size() - 1; n > 0; n--) {
+			const node_t& node = m_nodes[nodes[n]];
+			if (node.entry || !node.children.empty())
+				break;
+
+			m_nodes[nodes[n - 1]].children.erase(components_[n - 1]);
+			m_free.push_back(nodes[n]);
+		}
+
+		return true;
+	}
+
+	void zipfs_tree_t::clear() {
+		m_nodes.assign(1, node_t{});
+		m_free.clear();
+	}
+
+	void zipfs_tree_t::ls(const zipfs_path_t& zipfs_path, std::vector<zipfs_path_t>& result, bool strict) const {
+		zipfs_internal_assert(zipfs_path.is_dir());
+
+		size_t node = 0;
+		for (const std::string& c : components(zipfs_path)) {
+			auto find = m_nodes[node].children.find(c);
+			if (find == m_nodes[node].children.end())
+				return;
+			node = find->second;
+		}
+
+		if (!strict && m_nodes[node].entry)
+			result.push_back(zipfs_path);
+
+		ls(node, zipfs_path.string(), result);
+	}
+
+	std::vector<std::string> zipfs_tree_t::components(const zipfs_path_t& zipfs_path) {//"/a/b/c" -> { "a/", "b/", "c" }
+		const std::string& path = zipfs_path.string();
+
+		std::vector<std::string> components_;
+		size_t begin = 1;
+		while (begin < path.size()) {
+			size_t end = path.find('/', begin);
+			end = end == std::string::npos ? path.size() : end + 1;
+			components_.push_back(path.substr(begin, end - begin));
+			begin = end;
+		}
+		return components_;
+	}
+
+	void zipfs_tree_t::ls(size_t node, const std::string& path, std::vector<zipfs_path_t>& result) const {//pre-order: a directory is listed before its contents
+		for (const auto& child : m_nodes[node].children) {
+			std::string child_path = path + child.first;
+			if (m_nodes[child.second].entry)
+				result.push_back(child_path);
+			if (!m_nodes[child.second].children.empty())
+				ls(child.second, child_path, result);
+		}
+	}
+
+	size_t zipfs_tree_t::node_new() {
+		if (!m_free.empty()) {
+			size_t node = m_free.back();
+			m_free.pop_back();
+			m_nodes[node] = node_t{};
+			return node;
+		}
+
+		m_nodes.emplace_back();
+		return m_nodes.size() - 1;
+	}
+}
@@ -0,0 +1,26 @@
+#include <zipfs/zipfs_view_t.h>
+
+namespace zipfs {
+
+	zipfs_view_t::zipfs_view_t() :
+		m_size{ 0 }, m_direct{ false } {}
+
+	zipfs_view_t::zipfs_view_t(std::shared_ptr<const char> data, size_t byte_sz, bool direct) :
+		m_data{ std::move(data) }, m_size{ byte_sz }, m_direct{ direct } {}
+
+	const char* zipfs_view_t::data() const {
+		return m_data.get();
+	}
+
+	size_t zipfs_view_t::size() const {
+		return m_size;
+	}
+
+	bool zipfs_view_t::empty() const {
+		return m_size == 0;
+	}
+
+	bool zipfs_view_t::direct() const {
+		return m_direct;
+	}
+}
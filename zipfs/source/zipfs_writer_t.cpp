@@ -0,0 +1,93 @@
+#include <zipfs/zipfs_writer_t.h>
+#include <zipfs/zipfs_t.h>
+#include <zipfs/zipfs_spill_file_t.h>
+#include <zipfs/zipfs_assert.h>
+#include <zipfs/zipfs_error_strings.h>
+
+namespace zipfs {
+
+	namespace {
+
+		const size_t
+			s_buffer_size = 1 << 16;
+	}
+
+	zipfs_writer_t::zipfs_writer_t() :
+		m_zipfs_t{ nullptr }, m_zipfs_path{ "/" }, m_overwrite{ OVERWRITE::NEVER }, m_offset{ 0 }, m_size{ 0 } {}
+
+	zipfs_writer_t::~zipfs_writer_t() {
+		discard();
+	}
+
+	zipfs_error_t zipfs_writer_t::write(const char* data, size_t byte_sz) {
+		zipfs_usage_assert(is_open(), ZIPFS_ERRSTR_WRITER_NOT_OPEN);
+
+		if (m_buffer.size() + byte_sz > s_buffer_size && !flush()) {
+			zipfs_error_t ze = ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+			ze.set_zipfs_path(m_zipfs_path);
+			return ze;
+		}
+
+		if (byte_sz >= s_buffer_size) {//.>large chunk: written as is
+			if (!m_spill_file->write(m_offset + m_size, data, byte_sz)) {
+				zipfs_error_t ze = ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+				ze.set_zipfs_path(m_zipfs_path);
+				return ze;
+			}
+			m_size += byte_sz;
+		}
+		else {
+			m_buffer.insert(m_buffer.end(), data, data + byte_sz);
+		}
+
+		return zipfs_error_t::no_error();
+	}
+
+	zipfs_error_t zipfs_writer_t::write(const std::vector<char>& data) {
+		return write(data.data(), data.size());
+	}
+
+	zipfs_error_t zipfs_writer_t::finish() {
+		zipfs_usage_assert(is_open(), ZIPFS_ERRSTR_WRITER_NOT_OPEN);
+
+		zipfs_error_t ze = zipfs_error_t::no_error();
+		if (!flush()) {
+			ze = ZIPFS_ERRSTR_CANNOT_WRITE_SPILL_FILE;
+			ze.set_zipfs_path(m_zipfs_path);
+		}
+		else {
+			ze = m_zipfs_t->_zipfs_writer_finish(*this);
+		}
+
+		discard();
+		return ze;
+	}
+
+	void zipfs_writer_t::discard() {
+		m_zipfs_t = nullptr;
+		m_spill_file.reset();
+		m_offset = 0;
+		m_size = 0;
+		m_buffer.clear();
+		m_buffer.shrink_to_fit();
+	}
+
+	bool zipfs_writer_t::is_open() const {
+		return m_zipfs_t != nullptr;
+	}
+
+	zip_uint64_t zipfs_writer_t::size() const {
+		return m_size + m_buffer.size();
+	}
+
+	bool zipfs_writer_t::flush() {
+		if (m_buffer.empty())
+			return true;
+		else if (!m_spill_file->write(m_offset + m_size, m_buffer.data(), m_buffer.size()))
+			return false;
+
+		m_size += m_buffer.size();
+		m_buffer.clear();
+		return true;
+	}
+}
@@ -11,7 +11,6 @@
 #include <zipfs/zipfs.h>
 #include <iostream>
 #include <filesystem>
-#include <fstream>
 #include <cassert>
 
 using namespace zipfs;
@@ -89,13 +88,8 @@ int main(int argc, char** argv) {
 
 	//§8 write archive to HDD
 	{
-		std::vector<char> source;
-		ze = zfs.get_source(source);
+		ze = zfs.save("result.zip");
 		if (!ze) goto error;
-
-		std::ofstream ofs{ "result.zip", std::ios::binary };
-		ofs.write(source.data(), source.size());
-		ofs.close();
 	}
 
 	//end of sample
@@ -14,7 +14,6 @@
 #include <zipfs/zipfs.h>
 #include <iostream>
 #include <filesystem>
-#include <fstream>
 
 using namespace zipfs;
 
@@ -97,13 +96,8 @@ int main(int argc, char** argv) {
 	//5 write archive to HDD
 	{
 		//files are encrypted inside the archive
-		std::vector<char> source;
-		ze = zfs.get_source(source);
+		ze = zfs.save("result.zip");
 		if (!ze) goto error;
-
-		std::ofstream ofs{ "result.zip", std::ios::binary };
-		ofs.write(source.data(), source.size());
-		ofs.close();
 	}
 
 	//6 cat()'ing a file as encrypted or decrypted
@@ -8,8 +8,6 @@
 
 #include <zipfs/zipfs.h>
 #include <iostream>
-#include <filesystem>
-#include <fstream>
 
 void super_secret_encrypt_func(const char* filename, const uint8_t* buf, size_t len, uint8_t** ret_buf, size_t* ret_len) {
 	uint8_t* encrypted = new uint8_t[len];
@@ -28,17 +26,8 @@ int main(int argc, char** argv) {
 	const char* archive = "archive.zip";
 	const char* mirroring = "../zipfs_tutorial_3/dir-extract";
 
-	std::vector<char> source;
-	if (std::filesystem::exists(archive)) {
-		size_t sz = std::filesystem::file_size(archive);
-		source.resize(sz);
-		std::ifstream ifs{ archive, std::ios::binary };
-		ifs.read(source.data(), sz);
-		ifs.close();
-	}
-
 	zipfs_error_t ze;
-	zipfs_t zfs(source.data(), source.size(), ze);
+	zipfs_t zfs(filesystem_path_t{ archive }, ze);//file-backed: created if it doesn't exist, changes are written to it directly
 	if (!ze)
 		return -1;
 
@@ -56,14 +45,6 @@ int main(int argc, char** argv) {
 	if (!ze)
 		return -1;
 
-	ze = zfs.get_source(source);
-	if (!ze)
-		return -1;
-
-	std::ofstream ofs{ archive, std::ios::binary | std::ios::trunc };
-	ofs.write(source.data(), source.size());
-	ofs.close();
-
 	//try to add/remove/modify files in the mirrored directory, rerun the script, and see what happens.
 	return 0;
 }
\ No newline at end of file
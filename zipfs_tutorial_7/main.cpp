@@ -0,0 +1,182 @@
+/*
+	zipfs_tutorial_7 - round trips
+
+	Write paths where zipfs builds the zip data itself, instead of libzip, read back and compared.
+	Returns -1 on the first mismatch; also run by ctest.
+
+	- §1 block deflate: files of several blocks, an exact multiple of the block size, one byte, empty
+	- §2 COMMIT_MODE::APPEND: add, replace, delete, rename and a session, each spliced onto the archive
+*/
+#include <zipfs/zipfs.h>
+#include <zlib.h>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace zipfs;
+
+//half text, half noise: deflate emits both compressed and stored blocks
+std::vector<char> make_data(size_t byte_sz, unsigned int seed) {
+	std::vector<char> data(byte_sz);
+	for (size_t b = 0; b < byte_sz; b++) {
+		seed = seed * 1103515245 + 12345;
+		data[b] = (b / 4096) % 2 == 0 ? static_cast<char>('a' + b % 7) : static_cast<char>(seed >> 16);
+	}
+	return data;
+}
+
+bool check(bool ok, const std::string& what) {
+	if (!ok)
+		std::cout << "mismatch: " << what << std::endl;
+	return ok;
+}
+
+//the archive is reopened from its bytes with ZIP_CHECKCONS and must hold exactly files
+bool verify(zipfs_t& zfs, const std::map<std::string, std::string>& files, const std::string& step, zipfs_error_t& ze) {
+	std::vector<char> source;
+	ze = zfs.get_source(source);
+	if (!ze) return false;
+	zipfs_t reopened(std::move(source), ze);
+	if (!ze) return false;
+
+	zip_int64_t num_entries;
+	ze = reopened.num_entries(num_entries);
+	if (!ze) return false;
+	if (!check(num_entries == static_cast<zip_int64_t>(files.size()), step + ": entry count"))
+		return false;
+
+	for (const auto& file : files) {
+		std::vector<char> data;
+		ze = reopened.cat(file.first, data);
+		if (!ze) return false;
+		if (!check(std::string(data.begin(), data.end()) == file.second, step + ": " + file.first))
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+
+	zipfs_error_t ze;
+
+	//§1 block deflate
+	{
+		const size_t block_sz = 1 << 20;//block size of zipfs_block_deflate_t in file_pull()
+		const size_t sizes[] = { 3 * block_sz + 12345, 2 * block_sz, block_sz, 1, 0 };
+		std::vector<std::vector<char>> files;
+
+		zipfs_t zfs(ze);
+		if (!ze) goto error;
+		zfs.set_block_deflate(4, 0);//every pulled file is deflated in blocks, the empty one included
+
+		std::filesystem::create_directory("block-deflate");
+		for (size_t f = 0; f < sizeof(sizes) / sizeof(sizes[0]); f++) {
+			std::string name = "block-deflate/" + std::to_string(f);
+			files.push_back(make_data(sizes[f], static_cast<unsigned int>(f)));
+			std::ofstream(name, std::ios::binary).write(files[f].data(), static_cast<std::streamsize>(files[f].size()));
+
+			ze = zfs.file_pull("/" + name, name.c_str());
+			if (!ze) goto error;
+		}
+
+		//the archive is read back as is, then reopened from its bytes with ZIP_CHECKCONS
+		std::vector<char> source;
+		ze = zfs.get_source(source);
+		if (!ze) goto error;
+		zipfs_t reopened(std::move(source), ze);
+		if (!ze) goto error;
+
+		for (zipfs_t* zfs_ : { &zfs, &reopened }) {
+			for (size_t f = 0; f < files.size(); f++) {
+				std::string name = "/block-deflate/" + std::to_string(f);
+				zipfs_zip_stat_t stat;
+				std::vector<char> data;
+				ze = zfs_->stat(name, stat);
+				if (!ze) goto error;
+				ze = zfs_->cat(name, data);//libzip checks the stored CRC as it inflates
+				if (!ze) goto error;
+
+				uLong crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(files[f].data()), static_cast<uInt>(files[f].size()));
+				if (!check(stat.comp_method == ZIP_CM_DEFLATE, name + ": compression method") ||
+					!check(stat.crc == crc, name + ": crc32_combine() result") ||
+					!check(data == files[f], name + ": inflated data"))
+					return -1;
+			}
+		}
+	}
+
+	//§2 COMMIT_MODE::APPEND
+	{
+		std::map<std::string, std::string> files;//what the archive must hold
+		zip_uint64_t dead_space;
+
+		zipfs_t zfs(ze);
+		if (!ze) goto error;
+		zfs.set_commit_mode(COMMIT_MODE::APPEND);
+
+		//the first commit writes a new archive, the next ones are appended
+		for (const char* name : { "/a", "/b", "/c" }) {
+			files[name] = std::string(name) + " first";
+			ze = zfs.file_add(name, files[name]);
+			if (!ze) goto error;
+			if (!verify(zfs, files, std::string("add ") + name, ze)) goto mismatch;
+		}
+
+		files["/b"] = std::string(70000, 'b');
+		ze = zfs.file_add("/b", files["/b"], OVERWRITE::ALWAYS);
+		if (!ze) goto error;
+		if (!verify(zfs, files, "replace /b", ze)) goto mismatch;
+
+		files.erase("/a");
+		ze = zfs.file_delete("/a");
+		if (!ze) goto error;
+		if (!verify(zfs, files, "delete /a", ze)) goto mismatch;
+
+		files["/d"] = files["/c"];
+		files.erase("/c");
+		ze = zfs.file_rename("/c", "/d");
+		if (!ze) goto error;
+		if (!verify(zfs, files, "rename /c /d", ze)) goto mismatch;
+
+		//several changes, appended by one commit
+		ze = zfs.session_begin();
+		if (!ze) goto error;
+		files["/e"] = std::string(1 << 20, 'e');
+		ze = zfs.file_add("/e", files["/e"]);
+		if (!ze) goto error;
+		files["/d"] = "d replaced";
+		ze = zfs.file_add("/d", files["/d"], OVERWRITE::ALWAYS);
+		if (!ze) goto error;
+		files.erase("/b");
+		ze = zfs.file_delete("/b");
+		if (!ze) goto error;
+		ze = zfs.session_commit();
+		if (!ze) goto error;
+		if (!verify(zfs, files, "session", ze)) goto mismatch;
+
+		//replaced and deleted data stays behind: the changes were appended, not rewritten
+		ze = zfs.dead_space(dead_space);
+		if (!ze) goto error;
+		if (!check(dead_space != 0, "append: no dead space, the archive was rewritten"))
+			return -1;
+	}
+
+	//end of sample
+	goto end;
+
+mismatch:
+	if (!ze) goto error;
+	return -1;
+
+error:
+	{
+		std::cout << ze << std::endl;
+		return -1;
+	}
+
+end:
+	return 0;
+}